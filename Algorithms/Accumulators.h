@@ -0,0 +1,390 @@
+/*
+ * This file is part of libTIM.
+ *
+ * Copyright (©) 2005-2013  Benoit Naegel
+ * Copyright (©) 2013 Theo de Carpentier
+ * Copyright (©) 2022-2023  Cyril Meyer
+ */
+
+#ifndef Accumulators_h
+#define Accumulators_h
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "Common/Point.h"
+#include "Node.h"
+
+namespace LibTIM {
+
+/** @brief Type-erased attribute accumulator
+ * An accumulator keeps its own per-node state, indexed by Node::id, so
+ * attributes that are not requested cost neither memory nor traversal.
+ * The construction strategy calls newNode() when a node is created and
+ * addPixel() for each pixel flooded into it (update_attributes), then
+ * reorder() and merge() once the tree is built.
+ **/
+class AccumulatorBase {
+ public:
+  virtual ~AccumulatorBase(){};
+
+  virtual void newNode(Node *n) = 0;
+  virtual void addPixel(Node *n, const Point<TCoord> &p, int value) = 0;
+  // states are renumbered: new id i was old id oldIds[i]
+  virtual void reorder(const std::vector<int> &oldIds) = 0;
+  // merge sons into fathers (post-order) and finalize each node
+  virtual void merge(const std::vector<Node *> &nodes) = 0;
+};
+
+/** @brief Attribute accumulator wrapper
+ * TAcc describes a user-defined attribute:
+ *
+ *  struct TAcc {
+ *    typedef ... State;
+ *    typedef ... Result;
+ *    void init(State &s, Node *n);
+ *    void addPixel(State &s, const Point<TCoord> &p, int value);
+ *    void mergeChild(State &father, const State &child);
+ *    Result finalize(State &s, Node *n);
+ *  };
+ *
+ * States live only during construction (or accumulate()), results are kept
+ * and indexed by Node::id.
+ * Usage:
+ *   Accumulator<MyAcc> acc;
+ *   std::vector<AccumulatorBase *> accs(1, &acc);
+ *   ComponentTree<U8> tree(im, connexity, ca, delta, accs);
+ *   acc[node] ...
+ **/
+template <class TAcc>
+class Accumulator : public AccumulatorBase {
+ public:
+  typedef typename TAcc::State State;
+  typedef typename TAcc::Result Result;
+
+  Accumulator(const TAcc &acc = TAcc()) : m_acc(acc) {}
+
+  void newNode(Node *n) {
+    if (n->id >= (int)m_states.size()) m_states.resize(n->id + 1);
+    m_acc.init(m_states[n->id], n);
+  }
+
+  void addPixel(Node *n, const Point<TCoord> &p, int value) {
+    m_acc.addPixel(m_states[n->id], p, value);
+  }
+
+  void reorder(const std::vector<int> &oldIds);
+  void merge(const std::vector<Node *> &nodes);
+
+  const Result &operator[](const Node *n) const { return m_results[n->id]; }
+  const std::vector<Result> &results() const { return m_results; }
+  std::vector<Result> &results() { return m_results; }
+
+  TAcc &accumulator() { return m_acc; }
+
+ private:
+  TAcc m_acc;
+  std::vector<State> m_states;
+  std::vector<Result> m_results;
+};
+
+template <class TAcc>
+void Accumulator<TAcc>::reorder(const std::vector<int> &oldIds) {
+  std::vector<State> states(oldIds.size());
+  for (int i = 0; i < oldIds.size(); i++)
+    std::swap(states[i], m_states[oldIds[i]]);
+  m_states.swap(states);
+}
+
+template <class TAcc>
+void Accumulator<TAcc>::merge(const std::vector<Node *> &nodes) {
+  m_results.clear();
+  m_results.resize(nodes.size());
+
+  // reverse breadth-first order: all sons are complete before their father
+  for (int i = (int)nodes.size() - 1; i >= 0; i--) {
+    Node *n = nodes[i];
+    if (n->father != n)
+      m_acc.mergeChild(m_states[n->father->id], m_states[i]);
+    m_results[i] = m_acc.finalize(m_states[i], n);
+  }
+
+  // states are no longer needed
+  std::vector<State>().swap(m_states);
+}
+
+/** @brief Shape descriptors derived from the spatial moments of a node
+ * Moments are computed in the (x,y) plane.
+ **/
+struct ShapeMoments {
+  ShapeMoments() : inertia(0), elongation(0), orientation(0) {
+    for (int i = 0; i < 7; i++) hu[i] = 0;
+  }
+  // normalized moment of inertia I/A^2 (pixels seen as unit squares)
+  long double inertia;
+  // 1 - lambda_min/lambda_max of the covariance matrix (0: isotropic)
+  long double elongation;
+  // angle of the main axis, in radians
+  long double orientation;
+  // Hu invariant moments
+  long double hu[7];
+};
+
+/** @brief Raw spatial moments up to order 3, finalized into ShapeMoments
+ **/
+struct MomentsAccumulator {
+  struct State {
+    long double m00, m10, m01, m20, m11, m02, m30, m21, m12, m03;
+  };
+  typedef ShapeMoments Result;
+
+  void init(State &s, Node *n) {
+    s.m00 = s.m10 = s.m01 = s.m20 = s.m11 = s.m02 = 0;
+    s.m30 = s.m21 = s.m12 = s.m03 = 0;
+  }
+
+  void addPixel(State &s, const Point<TCoord> &p, int value) {
+    long double x = p.x;
+    long double y = p.y;
+    s.m00 += 1;
+    s.m10 += x;
+    s.m01 += y;
+    s.m20 += x * x;
+    s.m11 += x * y;
+    s.m02 += y * y;
+    s.m30 += x * x * x;
+    s.m21 += x * x * y;
+    s.m12 += x * y * y;
+    s.m03 += y * y * y;
+  }
+
+  void mergeChild(State &father, const State &child) {
+    father.m00 += child.m00;
+    father.m10 += child.m10;
+    father.m01 += child.m01;
+    father.m20 += child.m20;
+    father.m11 += child.m11;
+    father.m02 += child.m02;
+    father.m30 += child.m30;
+    father.m21 += child.m21;
+    father.m12 += child.m12;
+    father.m03 += child.m03;
+  }
+
+  Result finalize(State &s, Node *n);
+};
+
+inline MomentsAccumulator::Result MomentsAccumulator::finalize(State &s,
+                                                              Node *n) {
+  Result res;
+  if (s.m00 == 0) return res;
+
+  long double xc = s.m10 / s.m00;
+  long double yc = s.m01 / s.m00;
+
+  // central moments
+  long double mu20 = s.m20 - xc * s.m10;
+  long double mu02 = s.m02 - yc * s.m01;
+  long double mu11 = s.m11 - xc * s.m01;
+  long double mu30 = s.m30 - 3 * xc * s.m20 + 2 * xc * xc * s.m10;
+  long double mu03 = s.m03 - 3 * yc * s.m02 + 2 * yc * yc * s.m01;
+  long double mu21 =
+      s.m21 - 2 * xc * s.m11 - yc * s.m20 + 2 * xc * xc * s.m01;
+  long double mu12 =
+      s.m12 - 2 * yc * s.m11 - xc * s.m02 + 2 * yc * yc * s.m10;
+
+  // a unit square pixel has an inertia of 1/6
+  res.inertia = (mu20 + mu02 + s.m00 / 6.0) / (s.m00 * s.m00);
+
+  long double delta =
+      std::sqrt((mu20 - mu02) * (mu20 - mu02) + 4 * mu11 * mu11);
+  long double lambdaMax = (mu20 + mu02 + delta) / 2;
+  long double lambdaMin = (mu20 + mu02 - delta) / 2;
+  if (lambdaMax > 0)
+    res.elongation = 1 - std::max(lambdaMin, 0.0L) / lambdaMax;
+
+  res.orientation = 0.5 * std::atan2(2 * mu11, mu20 - mu02);
+
+  // scale invariant moments
+  long double a2 = s.m00 * s.m00;
+  long double a25 = a2 * std::sqrt(s.m00);
+  long double n20 = mu20 / a2, n02 = mu02 / a2, n11 = mu11 / a2;
+  long double n30 = mu30 / a25, n03 = mu03 / a25;
+  long double n21 = mu21 / a25, n12 = mu12 / a25;
+
+  long double p = n30 + n12, q = n21 + n03;
+  long double r = n30 - 3 * n12, t = 3 * n21 - n03;
+
+  res.hu[0] = n20 + n02;
+  res.hu[1] = (n20 - n02) * (n20 - n02) + 4 * n11 * n11;
+  res.hu[2] = r * r + t * t;
+  res.hu[3] = p * p + q * q;
+  res.hu[4] = r * p * (p * p - 3 * q * q) + t * q * (3 * p * p - q * q);
+  res.hu[5] = (n20 - n02) * (p * p - q * q) + 4 * n11 * p * q;
+  res.hu[6] = t * p * (p * p - 3 * q * q) - r * q * (3 * p * p - q * q);
+
+  return res;
+}
+
+/** @brief Sparse grey-level histogram of a node
+ * Only non-empty bins are stored, sorted by bin index.
+ **/
+struct GreyLevelHistogram {
+  struct Bin {
+    int bin;
+    int64_t count;
+  };
+  typedef std::vector<Bin> Bins;
+
+  GreyLevelHistogram()
+      : minValue(0),
+        binWidth(1),
+        count(0),
+        median(0),
+        entropy(0),
+        otsuThreshold(0),
+        otsu(0) {}
+
+  // grey level represented by a bin (center of the bucket)
+  long double value(int bin) const {
+    return minValue + bin * binWidth + (binWidth - 1) / 2;
+  }
+  long double quantile(long double q) const;
+
+  Bins bins;
+  int minValue;
+  long double binWidth;
+  int64_t count;
+
+  long double median;
+  // Shannon entropy (bits)
+  long double entropy;
+  // Otsu threshold (pixels > otsuThreshold form the upper class)
+  // and separability (between-class / total variance, in [0,1])
+  long double otsuThreshold;
+  long double otsu;
+};
+
+inline long double GreyLevelHistogram::quantile(long double q) const {
+  int64_t rank = 0;
+  for (int i = 0; i < bins.size(); i++) {
+    rank += bins[i].count;
+    if (rank >= q * count) return value(bins[i].bin);
+  }
+  return bins.empty() ? 0 : value(bins.back().bin);
+}
+
+/** @brief Per-node grey-level histograms with a bounded number of bins
+ * Grey levels in [minValue, maxValue] are bucketed into at most nbBins bins,
+ * and sons are merged into their father in the post-order pass.
+ **/
+struct HistogramAccumulator {
+  typedef GreyLevelHistogram::Bins State;
+  typedef GreyLevelHistogram Result;
+
+  HistogramAccumulator(int nbBins = 256, int minValue = 0, int maxValue = 255)
+      : minValue(minValue) {
+    int levels = maxValue - minValue + 1;
+    if (nbBins > levels || nbBins <= 0) nbBins = levels;
+    binWidth = (long double)levels / nbBins;
+    // integer width when possible: one grey level never spans two bins
+    if (levels % nbBins == 0) binWidth = levels / nbBins;
+  }
+
+  void init(State &s, Node *n) { s.clear(); }
+
+  void addPixel(State &s, const Point<TCoord> &p, int value) {
+    int bin = (int)((value - minValue) / binWidth);
+    // the own pixels of a node share the same grey level
+    if (!s.empty() && s.back().bin == bin) {
+      s.back().count++;
+      return;
+    }
+    GreyLevelHistogram::Bin b;
+    b.bin = bin;
+    b.count = 1;
+    State::iterator it = s.begin();
+    while (it != s.end() && it->bin < bin) ++it;
+    if (it != s.end() && it->bin == bin)
+      it->count++;
+    else
+      s.insert(it, b);
+  }
+
+  void mergeChild(State &father, const State &child);
+  Result finalize(State &s, Node *n);
+
+  int minValue;
+  long double binWidth;
+};
+
+inline void HistogramAccumulator::mergeChild(State &father,
+                                             const State &child) {
+  State res;
+  res.reserve(father.size() + child.size());
+  int i = 0, j = 0;
+  while (i < father.size() || j < child.size()) {
+    if (j == child.size() ||
+        (i < father.size() && father[i].bin < child[j].bin)) {
+      res.push_back(father[i++]);
+    } else if (i == father.size() || child[j].bin < father[i].bin) {
+      res.push_back(child[j++]);
+    } else {
+      res.push_back(father[i++]);
+      res.back().count += child[j++].count;
+    }
+  }
+  father.swap(res);
+}
+
+inline HistogramAccumulator::Result HistogramAccumulator::finalize(State &s,
+                                                                  Node *n) {
+  Result res;
+  res.minValue = minValue;
+  res.binWidth = binWidth;
+  res.bins.swap(s);
+
+  const GreyLevelHistogram::Bins &bins = res.bins;
+  long double sum = 0;
+  for (int i = 0; i < bins.size(); i++) {
+    res.count += bins[i].count;
+    sum += bins[i].count * res.value(bins[i].bin);
+  }
+  if (res.count == 0) return res;
+
+  res.median = res.quantile(0.5);
+
+  long double total = res.count;
+  long double mean = sum / total;
+  long double variance = 0;
+  for (int i = 0; i < bins.size(); i++) {
+    long double p = bins[i].count / total;
+    long double d = res.value(bins[i].bin) - mean;
+    res.entropy -= p * std::log2(p);
+    variance += p * d * d;
+  }
+
+  // exact Otsu criterion: maximal between-class variance
+  long double w0 = 0, sum0 = 0, best = 0;
+  res.otsuThreshold = res.value(bins[0].bin);
+  for (int i = 0; i + 1 < bins.size(); i++) {
+    w0 += bins[i].count;
+    sum0 += bins[i].count * res.value(bins[i].bin);
+    long double w1 = total - w0;
+    long double m0 = sum0 / w0;
+    long double m1 = (sum - sum0) / w1;
+    long double between = w0 * w1 * (m0 - m1) * (m0 - m1) / (total * total);
+    if (between > best) {
+      best = between;
+      res.otsuThreshold = res.value(bins[i].bin);
+    }
+  }
+  if (variance > 0) res.otsu = best / variance;
+
+  return res;
+}
+
+}  // namespace LibTIM
+
+#endif
@@ -0,0 +1,61 @@
+/*
+ * This file is part of libTIM.
+ *
+ * Copyright (©) 2005-2013  Benoit Naegel
+ * Copyright (©) 2013 Theo de Carpentier
+ * Copyright (©) 2022-2023  Cyril Meyer
+ */
+
+#ifndef AttributeKernels_h
+#define AttributeKernels_h
+
+#include <cstddef>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LIBTIM_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace LibTIM {
+
+enum SimdLevel { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+
+/// best instruction set available on the running processor
+SimdLevel bestSimdLevel();
+
+/** @brief Vectorised kernels finalising derived attributes
+ * The kernels work on contiguous per-node arrays (one value per node, same
+ * node order in every array), in double precision.
+ * The instruction set is chosen at run time (AVX2, SSE2 or scalar code).
+ **/
+namespace AttributeKernels {
+
+/// mean, variance and Otsu criterion from area, sum and sum of squares
+void statistics(std::size_t n, const double *area, const double *sum,
+                const double *sumSquare, const double *meanNghb,
+                const double *varianceNghb, double *mean, double *variance,
+                double *otsu, SimdLevel level = bestSimdLevel());
+
+/// area derivatives with respect to the father
+void areaDerivatives(std::size_t n, const double *area,
+                     const double *fatherArea, const double *h,
+                     const double *fatherH, double *derivativeAreaN_h,
+                     double *derivativeH, double *derivativeAreaN,
+                     SimdLevel level = bestSimdLevel());
+
+/// res = a - b
+void difference(std::size_t n, const double *a, const double *b, double *res,
+                SimdLevel level = bestSimdLevel());
+
+/// complexity (unchanged when the area is 0) and compacity
+void complexityAndCompacity(std::size_t n, const double *contourLength,
+                            const double *area, int *complexity,
+                            int *compacity, SimdLevel level = bestSimdLevel());
+
+}  // namespace AttributeKernels
+
+}  // namespace LibTIM
+
+#include "AttributeKernels.hxx"
+
+#endif
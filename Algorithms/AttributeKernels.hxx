@@ -0,0 +1,303 @@
+/*
+ * This file is part of libTIM.
+ *
+ * Copyright (©) 2005-2013  Benoit Naegel
+ * Copyright (©) 2013 Theo de Carpentier
+ * Copyright (©) 2022-2023  Cyril Meyer
+ */
+
+namespace LibTIM {
+
+inline SimdLevel bestSimdLevel() {
+#ifdef LIBTIM_X86_SIMD
+  static const SimdLevel level =
+      __builtin_cpu_supports("avx2")
+          ? SIMD_AVX2
+          : (__builtin_cpu_supports("sse2") ? SIMD_SSE2 : SIMD_SCALAR);
+  return level;
+#else
+  return SIMD_SCALAR;
+#endif
+}
+
+namespace AttributeKernels {
+
+// 4 * M_PI, as computed by computeComplexityAndCompacity
+const double FOUR_PI = 4 * 3.14159265358979323846;
+
+// Scalar versions, also used for the last elements of the vector versions
+
+inline void statisticsScalar(std::size_t n, const double *area,
+                             const double *sum, const double *sumSquare,
+                             const double *meanNghb, const double *varianceNghb,
+                             double *mean, double *variance, double *otsu) {
+  for (std::size_t i = 0; i < n; i++) {
+    mean[i] = sum[i] / area[i];
+    variance[i] = sumSquare[i] / area[i] - mean[i] * mean[i];
+    double d = mean[i] - meanNghb[i];
+    otsu[i] = (d * d) / (variance[i] + varianceNghb[i]);
+  }
+}
+
+inline void areaDerivativesScalar(std::size_t n, const double *area,
+                                  const double *fatherArea, const double *h,
+                                  const double *fatherH,
+                                  double *derivativeAreaN_h,
+                                  double *derivativeH,
+                                  double *derivativeAreaN) {
+  for (std::size_t i = 0; i < n; i++) {
+    double dArea = fatherArea[i] - area[i];
+    derivativeH[i] = dArea / (h[i] - fatherH[i]);
+    derivativeAreaN_h[i] = derivativeH[i] / area[i];
+    derivativeAreaN[i] = dArea / area[i];
+  }
+}
+
+inline void differenceScalar(std::size_t n, const double *a, const double *b,
+                             double *res) {
+  for (std::size_t i = 0; i < n; i++) res[i] = a[i] - b[i];
+}
+
+inline void complexityAndCompacityScalar(std::size_t n,
+                                         const double *contourLength,
+                                         const double *area, int *complexity,
+                                         int *compacity) {
+  for (std::size_t i = 0; i < n; i++) {
+    if (area[i] != 0)
+      complexity[i] = (int)(1000.0 * contourLength[i] / area[i]);
+    if (contourLength[i] != 0)
+      compacity[i] = (int)((FOUR_PI * area[i] /
+                            (contourLength[i] * contourLength[i])) *
+                           1000);
+    else
+      compacity[i] = 0;
+  }
+}
+
+#ifdef LIBTIM_X86_SIMD
+
+__attribute__((target("sse2"))) inline void statisticsSSE2(
+    std::size_t n, const double *area, const double *sum,
+    const double *sumSquare, const double *meanNghb,
+    const double *varianceNghb, double *mean, double *variance, double *otsu) {
+  std::size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d a = _mm_loadu_pd(area + i);
+    __m128d m = _mm_div_pd(_mm_loadu_pd(sum + i), a);
+    __m128d v = _mm_sub_pd(_mm_div_pd(_mm_loadu_pd(sumSquare + i), a),
+                           _mm_mul_pd(m, m));
+    __m128d d = _mm_sub_pd(m, _mm_loadu_pd(meanNghb + i));
+    __m128d o = _mm_div_pd(_mm_mul_pd(d, d),
+                           _mm_add_pd(v, _mm_loadu_pd(varianceNghb + i)));
+    _mm_storeu_pd(mean + i, m);
+    _mm_storeu_pd(variance + i, v);
+    _mm_storeu_pd(otsu + i, o);
+  }
+  statisticsScalar(n - i, area + i, sum + i, sumSquare + i, meanNghb + i,
+                   varianceNghb + i, mean + i, variance + i, otsu + i);
+}
+
+__attribute__((target("avx2"))) inline void statisticsAVX2(
+    std::size_t n, const double *area, const double *sum,
+    const double *sumSquare, const double *meanNghb,
+    const double *varianceNghb, double *mean, double *variance, double *otsu) {
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d a = _mm256_loadu_pd(area + i);
+    __m256d m = _mm256_div_pd(_mm256_loadu_pd(sum + i), a);
+    __m256d v = _mm256_sub_pd(_mm256_div_pd(_mm256_loadu_pd(sumSquare + i), a),
+                              _mm256_mul_pd(m, m));
+    __m256d d = _mm256_sub_pd(m, _mm256_loadu_pd(meanNghb + i));
+    __m256d o =
+        _mm256_div_pd(_mm256_mul_pd(d, d),
+                      _mm256_add_pd(v, _mm256_loadu_pd(varianceNghb + i)));
+    _mm256_storeu_pd(mean + i, m);
+    _mm256_storeu_pd(variance + i, v);
+    _mm256_storeu_pd(otsu + i, o);
+  }
+  statisticsScalar(n - i, area + i, sum + i, sumSquare + i, meanNghb + i,
+                   varianceNghb + i, mean + i, variance + i, otsu + i);
+}
+
+__attribute__((target("sse2"))) inline void areaDerivativesSSE2(
+    std::size_t n, const double *area, const double *fatherArea,
+    const double *h, const double *fatherH, double *derivativeAreaN_h,
+    double *derivativeH, double *derivativeAreaN) {
+  std::size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d a = _mm_loadu_pd(area + i);
+    __m128d dArea = _mm_sub_pd(_mm_loadu_pd(fatherArea + i), a);
+    __m128d dH = _mm_div_pd(
+        dArea, _mm_sub_pd(_mm_loadu_pd(h + i), _mm_loadu_pd(fatherH + i)));
+    _mm_storeu_pd(derivativeH + i, dH);
+    _mm_storeu_pd(derivativeAreaN_h + i, _mm_div_pd(dH, a));
+    _mm_storeu_pd(derivativeAreaN + i, _mm_div_pd(dArea, a));
+  }
+  areaDerivativesScalar(n - i, area + i, fatherArea + i, h + i, fatherH + i,
+                        derivativeAreaN_h + i, derivativeH + i,
+                        derivativeAreaN + i);
+}
+
+__attribute__((target("avx2"))) inline void areaDerivativesAVX2(
+    std::size_t n, const double *area, const double *fatherArea,
+    const double *h, const double *fatherH, double *derivativeAreaN_h,
+    double *derivativeH, double *derivativeAreaN) {
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d a = _mm256_loadu_pd(area + i);
+    __m256d dArea = _mm256_sub_pd(_mm256_loadu_pd(fatherArea + i), a);
+    __m256d dH =
+        _mm256_div_pd(dArea, _mm256_sub_pd(_mm256_loadu_pd(h + i),
+                                           _mm256_loadu_pd(fatherH + i)));
+    _mm256_storeu_pd(derivativeH + i, dH);
+    _mm256_storeu_pd(derivativeAreaN_h + i, _mm256_div_pd(dH, a));
+    _mm256_storeu_pd(derivativeAreaN + i, _mm256_div_pd(dArea, a));
+  }
+  areaDerivativesScalar(n - i, area + i, fatherArea + i, h + i, fatherH + i,
+                        derivativeAreaN_h + i, derivativeH + i,
+                        derivativeAreaN + i);
+}
+
+__attribute__((target("sse2"))) inline void differenceSSE2(std::size_t n,
+                                                           const double *a,
+                                                           const double *b,
+                                                           double *res) {
+  std::size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    _mm_storeu_pd(res + i,
+                  _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+  differenceScalar(n - i, a + i, b + i, res + i);
+}
+
+__attribute__((target("avx2"))) inline void differenceAVX2(std::size_t n,
+                                                           const double *a,
+                                                           const double *b,
+                                                           double *res) {
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(
+        res + i, _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+  differenceScalar(n - i, a + i, b + i, res + i);
+}
+
+__attribute__((target("sse2"))) inline void complexityAndCompacitySSE2(
+    std::size_t n, const double *contourLength, const double *area,
+    int *complexity, int *compacity) {
+  const __m128d zero = _mm_setzero_pd();
+  std::size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d cl = _mm_loadu_pd(contourLength + i);
+    __m128d a = _mm_loadu_pd(area + i);
+
+    // complexity is kept where the area is 0
+    __m128d cx = _mm_div_pd(_mm_mul_pd(_mm_set1_pd(1000.0), cl), a);
+    __m128d old = _mm_cvtepi32_pd(
+        _mm_loadl_epi64(reinterpret_cast<__m128i *>(complexity + i)));
+    __m128d isZero = _mm_cmpeq_pd(a, zero);
+    cx = _mm_or_pd(_mm_and_pd(isZero, old), _mm_andnot_pd(isZero, cx));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(complexity + i),
+                     _mm_cvttpd_epi32(cx));
+
+    __m128d cp = _mm_mul_pd(_mm_div_pd(_mm_mul_pd(_mm_set1_pd(FOUR_PI), a),
+                                       _mm_mul_pd(cl, cl)),
+                            _mm_set1_pd(1000.0));
+    cp = _mm_andnot_pd(_mm_cmpeq_pd(cl, zero), cp);
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(compacity + i),
+                     _mm_cvttpd_epi32(cp));
+  }
+  complexityAndCompacityScalar(n - i, contourLength + i, area + i,
+                               complexity + i, compacity + i);
+}
+
+__attribute__((target("avx2"))) inline void complexityAndCompacityAVX2(
+    std::size_t n, const double *contourLength, const double *area,
+    int *complexity, int *compacity) {
+  const __m256d zero = _mm256_setzero_pd();
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d cl = _mm256_loadu_pd(contourLength + i);
+    __m256d a = _mm256_loadu_pd(area + i);
+
+    // complexity is kept where the area is 0
+    __m256d cx = _mm256_div_pd(_mm256_mul_pd(_mm256_set1_pd(1000.0), cl), a);
+    __m256d old = _mm256_cvtepi32_pd(
+        _mm_loadu_si128(reinterpret_cast<__m128i *>(complexity + i)));
+    cx = _mm256_blendv_pd(cx, old, _mm256_cmp_pd(a, zero, _CMP_EQ_OQ));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(complexity + i),
+                     _mm256_cvttpd_epi32(cx));
+
+    __m256d cp = _mm256_mul_pd(
+        _mm256_div_pd(_mm256_mul_pd(_mm256_set1_pd(FOUR_PI), a),
+                      _mm256_mul_pd(cl, cl)),
+        _mm256_set1_pd(1000.0));
+    cp = _mm256_blendv_pd(cp, zero, _mm256_cmp_pd(cl, zero, _CMP_EQ_OQ));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(compacity + i),
+                     _mm256_cvttpd_epi32(cp));
+  }
+  complexityAndCompacityScalar(n - i, contourLength + i, area + i,
+                               complexity + i, compacity + i);
+}
+
+#endif
+
+inline void statistics(std::size_t n, const double *area, const double *sum,
+                       const double *sumSquare, const double *meanNghb,
+                       const double *varianceNghb, double *mean,
+                       double *variance, double *otsu, SimdLevel level) {
+#ifdef LIBTIM_X86_SIMD
+  if (level == SIMD_AVX2)
+    return statisticsAVX2(n, area, sum, sumSquare, meanNghb, varianceNghb,
+                          mean, variance, otsu);
+  if (level == SIMD_SSE2)
+    return statisticsSSE2(n, area, sum, sumSquare, meanNghb, varianceNghb,
+                          mean, variance, otsu);
+#endif
+  statisticsScalar(n, area, sum, sumSquare, meanNghb, varianceNghb, mean,
+                   variance, otsu);
+}
+
+inline void areaDerivatives(std::size_t n, const double *area,
+                            const double *fatherArea, const double *h,
+                            const double *fatherH, double *derivativeAreaN_h,
+                            double *derivativeH, double *derivativeAreaN,
+                            SimdLevel level) {
+#ifdef LIBTIM_X86_SIMD
+  if (level == SIMD_AVX2)
+    return areaDerivativesAVX2(n, area, fatherArea, h, fatherH,
+                               derivativeAreaN_h, derivativeH,
+                               derivativeAreaN);
+  if (level == SIMD_SSE2)
+    return areaDerivativesSSE2(n, area, fatherArea, h, fatherH,
+                               derivativeAreaN_h, derivativeH,
+                               derivativeAreaN);
+#endif
+  areaDerivativesScalar(n, area, fatherArea, h, fatherH, derivativeAreaN_h,
+                        derivativeH, derivativeAreaN);
+}
+
+inline void difference(std::size_t n, const double *a, const double *b,
+                       double *res, SimdLevel level) {
+#ifdef LIBTIM_X86_SIMD
+  if (level == SIMD_AVX2) return differenceAVX2(n, a, b, res);
+  if (level == SIMD_SSE2) return differenceSSE2(n, a, b, res);
+#endif
+  differenceScalar(n, a, b, res);
+}
+
+inline void complexityAndCompacity(std::size_t n, const double *contourLength,
+                                   const double *area, int *complexity,
+                                   int *compacity, SimdLevel level) {
+#ifdef LIBTIM_X86_SIMD
+  if (level == SIMD_AVX2)
+    return complexityAndCompacityAVX2(n, contourLength, area, complexity,
+                                      compacity);
+  if (level == SIMD_SSE2)
+    return complexityAndCompacitySSE2(n, contourLength, area, complexity,
+                                      compacity);
+#endif
+  complexityAndCompacityScalar(n, contourLength, area, complexity, compacity);
+}
+
+}  // namespace AttributeKernels
+
+}  // namespace LibTIM
@@ -9,117 +9,19 @@
 #ifndef ComponentTree_h
 #define ComponentTree_h
 
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+#include "Accumulators.h"
+#include "AttributeKernels.h"
+#include "Common/TaskScheduler.h"
 #include "Morphology.h"
 
 namespace LibTIM {
 
 using std::vector;
 
-/** @brief Component tree representation of an image
- * The component tree (or max-tree) is a particular image structure.
- * Nodes represents flat zones.
- * Leafs represents regional maxima (max-tree) or minima (min-tree).
- * Father-son relation represents an inclusion relation
- * (with respect to level sets representation of image).
- * This structure is efficient for computing attribute openings.
- **/
-const int localMax = std::numeric_limits<int>::max();
-const int localMin = std::numeric_limits<int>::min();
-
-struct Node {
-  Node()
-      : label(-1),
-        xmin(localMax),
-        ymin(localMax),
-        xmax(localMin),
-        ymax(localMin),
-        area(0),
-        area_derivative_areaN_h(std::numeric_limits<long double>::max()),
-        area_derivative_areaN_h_derivative(
-            std::numeric_limits<long double>::max()),
-        area_derivative_h(std::numeric_limits<long double>::max()),
-        area_derivative_areaN(std::numeric_limits<long double>::max()),
-        mser(std::numeric_limits<long double>::max()),
-        area_derivative_delta_h(std::numeric_limits<long double>::max()),
-        area_derivative_delta_areaF(std::numeric_limits<long double>::max()),
-        sum(0),
-        sum_square(0),
-        mean(0),
-        variance(0),
-        area_nghb(0),
-        sum_nghb(0),
-        sum_square_nghb(0),
-        mean_nghb(0),
-        variance_nghb(0),
-        contrast(0),
-        volume(0),
-        contourLength(0),
-        complexity(0),
-        subNodes(0),
-        status(true),
-        active(true),
-        father(0) {
-    pixels.reserve(7);
-    childs.reserve(5);
-  }
-  int label;
-  int ori_h;
-  int h;
-  int xmin;
-  int ymin;
-  int xmax;
-  int ymax;
-  int zmin;
-  int zmax;
-  int64_t area;
-  // father correspond au noeud père
-  long double area_derivative_areaN_h;
-  long double area_derivative_areaN_h_derivative;
-  // (aire(father) - aire(noeud) / (h(noeud) - h(father))
-  long double area_derivative_h;
-  // (aire(father) - aire(noeud)) / aire(noeud)
-  long double area_derivative_areaN;
-  // father_d correspond au noeud dans la branche parent tel que  (h(noeud) -
-  // h(father_d)) >= delta (aire(father_d) - aire(noeud)) / aire(noeud)
-  long double mser;
-  // (aire(father_d) - aire(noeud)) / (h(noeud) - h(father_d))
-  long double area_derivative_delta_h;
-  // (aire(father_d) - aire(noeud)) / aire(father_d)
-  long double area_derivative_delta_areaF;
-  // otsu
-  int64_t sum;
-  int64_t sum_square;
-  long double mean;
-  long double variance;
-  int64_t area_nghb;
-  int64_t sum_nghb;
-  int64_t sum_square_nghb;
-  long double mean_nghb;
-  long double variance_nghb;
-  long double otsu;
-
-  int contrast;
-  int volume;
-  long double mean_gradient_border;
-  int contourLength;
-  int complexity;
-  int compacity;
-
-  int64_t subNodes;
-
-  bool status;
-  bool active;
-
-  // Common to all type of nodes:
-  Node *father;
-  typedef std::vector<TOffset> ContainerPixels;
-  ContainerPixels pixels;
-  ContainerPixels pixels_border;
-  typedef std::vector<Node *> ContainerChilds;
-  ContainerChilds childs;
-  ContainerPixels contour;
-};
-
 typedef std::vector<std::vector<Node *> > IndexType;
 
 enum ComputedAttributes {
@@ -132,6 +34,48 @@ enum ComputedAttributes {
   COMP_LEXITY_ACITY = 0b01000000,
   BOUNDING_BOX = 0b10000000,
   SUB_NODES = 0b0100000000,
+  MOMENTS = 0b1000000000,
+  HISTOGRAM = 0b10000000000,
+  EXTINCTION = 0b100000000000,
+  DYNAMICS = 0b1000000000000,
+  INSCRIBED_RADIUS = 0b10000000000000,
+};
+
+/** @brief Box of pixels: origin (x, y, z) and size
+ **/
+struct ImageRegion {
+  ImageRegion(TCoord x, TCoord y, TSize sizeX, TSize sizeY)
+      : x(x), y(y), z(0) {
+    size[0] = sizeX;
+    size[1] = sizeY;
+    size[2] = 1;
+  }
+  ImageRegion(TCoord x, TCoord y, TCoord z, TSize sizeX, TSize sizeY,
+              TSize sizeZ)
+      : x(x), y(y), z(z) {
+    size[0] = sizeX;
+    size[1] = sizeY;
+    size[2] = sizeZ;
+  }
+
+  const TSize *getSize() const { return size; }
+  TOffset getBufSize() const { return size[0] * size[1] * size[2]; }
+
+  TCoord x, y, z;
+  TSize size[3];
+};
+
+/** @brief Values mapped to the whole range of a quantised output
+ * A value is clamped to [low, high] and scaled to [0, max] for an integer
+ * output type (truncated), to [0, 1] for a floating point one.
+ * high <= low selects the largest value of the image (at least low + 1),
+ * read on the nodes. NaN values (e.g. unset attributes) are mapped to low.
+ **/
+struct ValueRange {
+  ValueRange(long double low = 0, long double high = 0)
+      : low(low), high(high) {}
+
+  long double low, high;
 };
 
 template <class T>
@@ -140,22 +84,104 @@ class ComponentTreeStrategy;
 template <class T>
 class SalembierRecursiveImplementation;
 
+/** @brief Component tree representation of an image
+ * The component tree (or max-tree) is a particular image structure.
+ * Nodes represents flat zones.
+ * Leafs represents regional maxima (max-tree) or minima (min-tree).
+ * Father-son relation represents an inclusion relation
+ * (with respect to level sets representation of image).
+ * This structure is efficient for computing attribute openings.
+ **/
 template <class T>
 class ComponentTree {
  public:
-  ComponentTree(){};
+  ComponentTree()
+      : m_root(0),
+        m_histogramBins(256),
+        m_strategy(0),
+        m_computed(0),
+        m_delta(1),
+        m_scheduler(0),
+        m_vectorized(false),
+        m_extinctionAttribute(AREA){};
   ComponentTree(Image<T> &img);
   ComponentTree(Image<T> &img, FlatSE &connexity);
   ComponentTree(Image<T> &img, FlatSE &connexity, unsigned int delta);
   ComponentTree(Image<T> &img, FlatSE &connexity, ComputedAttributes ca,
                 unsigned int delta);
+  // histogramBins: number of bins of the HISTOGRAM attribute
+  ComponentTree(Image<T> &img, FlatSE &connexity, ComputedAttributes ca,
+                unsigned int delta, int histogramBins);
+  ComponentTree(Image<T> &img, FlatSE &connexity, ComputedAttributes ca,
+                unsigned int delta,
+                const std::vector<AccumulatorBase *> &accumulators,
+                int histogramBins = 256);
   ~ComponentTree();
 
   int computeNeighborhoodAttributes(int r);
 
-  enum ConstructionDecision { MIN, MAX, DIRECT };
+  /**
+   * @brief Compute the attributes of ca (a ComputedAttributes mask) that are
+   * not yet available, with their dependencies. Already computed attributes
+   * are not computed again.
+   **/
+  int computeAttributes(int ca);
+
+  /**
+   * @brief Feed an accumulator with the pixels of an existing tree
+   * (one pass over the node pixels, followed by the post-order merge)
+   **/
+  int accumulate(AccumulatorBase &acc);
+
+  /**
+   * @brief Number of bins used by the HISTOGRAM attribute (default 256)
+   * Must be set before the histograms are computed (see the constructor
+   * parameter when HISTOGRAM is computed with the tree).
+   **/
+  void setHistogramBins(int bins) { m_histogramBins = bins; }
+  /**
+   * @brief Grey-level quantile of a node, q in [0,1]
+   **/
+  long double getQuantile(Node *n, long double q);
+
+  /**
+   * @brief Number of threads used to compute the attributes and to render
+   * the images (constructImage*, by bands of rows)
+   * 1 (default) is sequential, 0 uses all the cores.
+   **/
+  void setNumberOfThreads(int nbThreads);
+  /**
+   * @brief Finalise mean, variance, otsu, area derivatives, complexity and
+   * compacity with vectorised kernels (in double precision)
+   **/
+  void setVectorizedAttributes(bool vectorized) { m_vectorized = vectorized; }
+
+  enum ConstructionDecision { MIN, MAX, DIRECT, SUBTRACTIVE };
   Image<T> constructImage(ConstructionDecision decision = MIN);
+  /**
+   * @brief Reconstruction into an output buffer, e.g. reused across calls
+   * res is resized if needed; a raw buffer (possibly external) must hold
+   * getBufSize() values of the image (of roi for a region).
+   * The original image is left untouched.
+   **/
+  void constructImage(Image<T> &res, ConstructionDecision decision = MIN);
+  void constructImage(T *res, ConstructionDecision decision = MIN);
+  /**
+   * @brief MIN reconstruction written into the original image (which is
+   * lost, see constructImage(res) to keep it)
+   **/
   Image<T> &constructImageOptimized();
+  /**
+   * @brief Reconstruction of a region only (output of the size of roi)
+   * The work is proportional to the region (but for MAX, whose levels depend
+   * on the descendants of the nodes); pixels outside the image are 0.
+   **/
+  Image<T> constructImage(const ImageRegion &roi,
+                          ConstructionDecision decision = MIN);
+  void constructImage(Image<T> &res, const ImageRegion &roi,
+                      ConstructionDecision decision = MIN);
+  void constructImage(T *res, const ImageRegion &roi,
+                      ConstructionDecision decision = MIN);
 
   enum Attribute {
     H,
@@ -177,8 +203,84 @@ class ComponentTree {
     MGB,
     CONTOUR_LENGTH,
     COMPLEXITY,
-    COMPACITY
+    COMPACITY,
+    INERTIA,
+    ELONGATION,
+    ORIENTATION,
+    HU_1,
+    HU_2,
+    HU_3,
+    HU_4,
+    HU_5,
+    HU_6,
+    HU_7,
+    MEDIAN,
+    ENTROPY,
+    OTSU_HISTOGRAM,
+    EXTINCTION,
+    DYNAMICS,
+    INSCRIBED_RADIUS
   };
+
+  /**
+   * @brief Extinction values of a per-node column (indexed by Node::id)
+   * At each node, the son whose branch reaches the highest value survives,
+   * the branches of the other sons die at their highest value.
+   * The extinction value of a node is the one of the branch of its dominant
+   * leaf (the extinction value of a leaf is the one of its regional extremum).
+   **/
+  std::vector<long double> computeExtinction(
+      const std::vector<long double> &column);
+  /**
+   * @brief Extinction values of an attribute, then read with the EXTINCTION
+   * attribute (AREA is used when EXTINCTION is read first)
+   **/
+  int computeExtinctionValues(Attribute attribute_id);
+  /**
+   * @brief Radius of the largest euclidean ball (disk for 2D images) included
+   * in each node, read with the INSCRIBED_RADIUS attribute
+   **/
+  int computeInscribedRadius();
+
+  /**
+   * @brief Values of an attribute for all nodes, indexed by Node::id
+   **/
+  std::vector<long double> attributeColumn(Attribute attribute_id);
+  /**
+   * @brief Same into column (resized), the attribute being available
+   * The attribute is resolved once per column, not once per node, so the
+   * loop over the nodes only loads the values.
+   **/
+  template <class TVal>
+  void attributeValues(Attribute attribute_id, std::vector<TVal> &column);
+
+  /**
+   * @brief Pattern spectrum (granulometry) of a per-node column
+   * Bin i sums the volume area * (h - h(father)) of the nodes whose value v
+   * is in [thresholds[i-1], thresholds[i]) (bin 0: v < thresholds[0], last
+   * bin: v >= thresholds.back()), so thresholds.size() + 1 bins.
+   * The cumulated bins 0..i give the volume removed by the filter keeping the
+   * nodes with v >= thresholds[i] (for an increasing attribute).
+   * thresholds must be sorted and column hold one value per node, otherwise
+   * the result is empty.
+   **/
+  std::vector<long double> patternSpectrum(
+      const std::vector<long double> &column,
+      const std::vector<long double> &thresholds);
+  std::vector<long double> patternSpectrum(
+      Attribute attribute_id, const std::vector<long double> &thresholds);
+  /**
+   * @brief 2D pattern spectrum, res[i][j]: bin i of column1 and j of column2
+   * (empty under the same conditions)
+   **/
+  std::vector<std::vector<long double> > patternSpectrum(
+      const std::vector<long double> &column1,
+      const std::vector<long double> &thresholds1,
+      const std::vector<long double> &column2,
+      const std::vector<long double> &thresholds2);
+  std::vector<std::vector<long double> > patternSpectrum(
+      Attribute attribute1, const std::vector<long double> &thresholds1,
+      Attribute attribute2, const std::vector<long double> &thresholds2);
   template <class TVal, class TSel>
   Image<TVal> constructImageAttribute(
       Attribute value_attribute, Attribute selection_attribute = MSER,
@@ -191,6 +293,213 @@ class ComponentTree {
       Attribute limit_attribute = AREA, TLimit limit_min = 0,
       TLimit limit_max = std::numeric_limits<TLimit>::max());
 
+  /**
+   * @brief Attribute images into an output buffer (see constructImage)
+   **/
+  template <class TVal, class TSel>
+  void constructImageAttribute(Image<TVal> &res, Attribute value_attribute,
+                               Attribute selection_attribute = MSER,
+                               ConstructionDecision selection_rule = DIRECT);
+  template <class TVal, class TSel>
+  void constructImageAttribute(TVal *res, Attribute value_attribute,
+                               Attribute selection_attribute = MSER,
+                               ConstructionDecision selection_rule = DIRECT);
+
+  template <class TVal, class TSel, class TLimit>
+  void constructImageAttribute(
+      Image<TVal> &res, Attribute value_attribute,
+      Attribute selection_attribute = MSER,
+      ConstructionDecision selection_rule = DIRECT,
+      Attribute limit_attribute = AREA, TLimit limit_min = 0,
+      TLimit limit_max = std::numeric_limits<TLimit>::max());
+  template <class TVal, class TSel, class TLimit>
+  void constructImageAttribute(
+      TVal *res, Attribute value_attribute,
+      Attribute selection_attribute = MSER,
+      ConstructionDecision selection_rule = DIRECT,
+      Attribute limit_attribute = AREA, TLimit limit_min = 0,
+      TLimit limit_max = std::numeric_limits<TLimit>::max());
+
+  /**
+   * @brief Attribute images of a region only (output of the size of roi)
+   **/
+  template <class TVal, class TSel>
+  Image<TVal> constructImageAttribute(
+      const ImageRegion &roi, Attribute value_attribute,
+      Attribute selection_attribute = MSER,
+      ConstructionDecision selection_rule = DIRECT);
+  template <class TVal, class TSel>
+  void constructImageAttribute(Image<TVal> &res, const ImageRegion &roi,
+                               Attribute value_attribute,
+                               Attribute selection_attribute = MSER,
+                               ConstructionDecision selection_rule = DIRECT);
+  template <class TVal, class TSel>
+  void constructImageAttribute(TVal *res, const ImageRegion &roi,
+                               Attribute value_attribute,
+                               Attribute selection_attribute = MSER,
+                               ConstructionDecision selection_rule = DIRECT);
+
+  template <class TVal, class TSel, class TLimit>
+  Image<TVal> constructImageAttribute(
+      const ImageRegion &roi, Attribute value_attribute,
+      Attribute selection_attribute = MSER,
+      ConstructionDecision selection_rule = DIRECT,
+      Attribute limit_attribute = AREA, TLimit limit_min = 0,
+      TLimit limit_max = std::numeric_limits<TLimit>::max());
+  template <class TVal, class TSel, class TLimit>
+  void constructImageAttribute(
+      Image<TVal> &res, const ImageRegion &roi, Attribute value_attribute,
+      Attribute selection_attribute = MSER,
+      ConstructionDecision selection_rule = DIRECT,
+      Attribute limit_attribute = AREA, TLimit limit_min = 0,
+      TLimit limit_max = std::numeric_limits<TLimit>::max());
+  template <class TVal, class TSel, class TLimit>
+  void constructImageAttribute(
+      TVal *res, const ImageRegion &roi, Attribute value_attribute,
+      Attribute selection_attribute = MSER,
+      ConstructionDecision selection_rule = DIRECT,
+      Attribute limit_attribute = AREA, TLimit limit_min = 0,
+      TLimit limit_max = std::numeric_limits<TLimit>::max());
+
+  /**
+   * @brief Parameters of an attribute image (see constructImageAttribute)
+   * The limit is only used by the second constructor.
+   **/
+  struct AttributeImageSpec {
+    AttributeImageSpec(Attribute value, Attribute selection = MSER,
+                       ConstructionDecision rule = DIRECT)
+        : value_attribute(value),
+          selection_attribute(selection),
+          selection_rule(rule),
+          limited(false),
+          limit_attribute(AREA),
+          limit_min(0),
+          limit_max(0) {}
+    AttributeImageSpec(Attribute value, Attribute selection,
+                       ConstructionDecision rule, Attribute limit,
+                       long double lmin, long double lmax)
+        : value_attribute(value),
+          selection_attribute(selection),
+          selection_rule(rule),
+          limited(true),
+          limit_attribute(limit),
+          limit_min(lmin),
+          limit_max(lmax) {}
+    Attribute value_attribute;
+    Attribute selection_attribute;
+    ConstructionDecision selection_rule;
+    bool limited;
+    Attribute limit_attribute;
+    // converted to TLimit
+    long double limit_min;
+    long double limit_max;
+  };
+  /**
+   * @brief Attribute images of several specifications at once
+   * res[i] is the image of specs[i]. The attribute columns and the
+   * selections shared by several specifications are computed once, and all
+   * the images are written in one scan of the pixels.
+   **/
+  template <class TVal, class TSel, class TLimit>
+  std::vector<Image<TVal> > constructImageAttributes(
+      const std::vector<AttributeImageSpec> &specs);
+  template <class TVal, class TSel, class TLimit>
+  void constructImageAttributes(const std::vector<AttributeImageSpec> &specs,
+                                std::vector<Image<TVal> > &res);
+  template <class TVal, class TSel, class TLimit>
+  void constructImageAttributes(const std::vector<AttributeImageSpec> &specs,
+                                TVal *const *res);
+  /**
+   * @brief Same converted to TOut (e.g. U8, U16 or float), res[i] being
+   * quantised with ranges[i]
+   * The conversion is applied once per node, before the pixels are written;
+   * attribute values are read as TVal.
+   * ranges must hold one range per spec, otherwise nothing is written (and
+   * res is empty).
+   **/
+  template <class TOut, class TSel, class TLimit, class TVal = long double>
+  std::vector<Image<TOut> > constructImageAttributes(
+      const std::vector<AttributeImageSpec> &specs,
+      const std::vector<ValueRange> &ranges);
+  template <class TOut, class TSel, class TLimit, class TVal = long double>
+  void constructImageAttributes(const std::vector<AttributeImageSpec> &specs,
+                                const std::vector<ValueRange> &ranges,
+                                std::vector<Image<TOut> > &res);
+  template <class TOut, class TSel, class TLimit, class TVal = long double>
+  void constructImageAttributes(const std::vector<AttributeImageSpec> &specs,
+                                const std::vector<ValueRange> &ranges,
+                                TOut *const *res);
+
+  // channels of a pixel stored together (HWC) or one image per channel (CHW)
+  enum TensorLayout { HWC, CHW };
+  /**
+   * @brief Quantised attribute images of specs as the channels of one tensor
+   * res holds specs.size() values per pixel: channel c of offset p is at
+   * p * specs.size() + c (HWC) or at c * getBufSize() + p (CHW).
+   * Nothing is written unless ranges holds one range per spec.
+   **/
+  template <class TOut, class TSel, class TLimit, class TVal = long double>
+  void constructAttributeTensor(const std::vector<AttributeImageSpec> &specs,
+                                const std::vector<ValueRange> &ranges,
+                                TensorLayout layout, TOut *res);
+  /**
+   * @brief Same saved as a .npy file (e.g. TOut = U8 or float), of shape
+   * (H, W, C) / (C, H, W), or (D, H, W, C) / (C, D, H, W) for a volume
+   * Return 0 if ranges does not hold one range per spec or on I/O error.
+   **/
+  template <class TOut, class TSel, class TLimit, class TVal = long double>
+  int saveAttributeTensor(const char *filename,
+                          const std::vector<AttributeImageSpec> &specs,
+                          const std::vector<ValueRange> &ranges,
+                          TensorLayout layout = HWC);
+
+  /**
+   * @brief Signature of an attribute at several levels
+   * Plane k holds at each pixel the value of the first node met from the
+   * pixel towards the root (excluded) whose level h is at most
+   * thresholds[k], 0 if none.
+   * The planes are filled in one pass over the nodes and one scan of the
+   * pixels.
+   **/
+  template <class TVal>
+  std::vector<Image<TVal> > constructSignature(
+      Attribute value_attribute, const std::vector<int> &thresholds);
+  template <class TVal>
+  void constructSignature(std::vector<Image<TVal> > &res,
+                          Attribute value_attribute,
+                          const std::vector<int> &thresholds);
+  template <class TVal>
+  void constructSignature(TVal *const *res, Attribute value_attribute,
+                          const std::vector<int> &thresholds);
+  /**
+   * @brief Same converted to TOut, all the planes being quantised with range
+   * (see constructImageAttributes)
+   **/
+  template <class TOut, class TVal = long double>
+  std::vector<Image<TOut> > constructSignature(
+      Attribute value_attribute, const std::vector<int> &thresholds,
+      const ValueRange &range);
+  template <class TOut, class TVal = long double>
+  void constructSignature(std::vector<Image<TOut> > &res,
+                          Attribute value_attribute,
+                          const std::vector<int> &thresholds,
+                          const ValueRange &range);
+  template <class TOut, class TVal = long double>
+  void constructSignature(TOut *const *res, Attribute value_attribute,
+                          const std::vector<int> &thresholds,
+                          const ValueRange &range);
+
+  /**
+   * @brief Node::id of the node of each pixel, indexed by offset
+   * The map is built with the tree (32 bits per pixel) and returned without
+   * copy; the node of offset p is m_nodes[nodeIds()[p]]. It is the only
+   * pixel-to-node map kept: contours and border gradients are read from it.
+   * It replaces the public STATUS image and max-tree index of the tree:
+   * index[h - hMin][STATUS(p)] is now m_nodes[nodeIds()[p]] (or
+   * offsetToNode(p)).
+   **/
+  const std::vector<int32_t> &nodeIds() const { return m_nodeIds; }
+
   /**
    * @brief Restore original tree (i.e. clear all filtering)
    **/
@@ -210,6 +519,24 @@ class ComponentTree {
    **/
   int contrastFiltering(int tMin, int tMax = std::numeric_limits<int>::max());
 
+  /**
+   * @brief Generic filtering
+   * Each node is kept (active) if keep(const Node &) is true, removed
+   * otherwise; the previous filtering is replaced, so restore() is not
+   * needed. ca is the ComputedAttributes mask read by the predicate.
+   * Example: filter([](const Node &n) {
+   *   return n.area > 100 && n.compacity > 300; }, AREA | COMP_LEXITY_ACITY);
+   **/
+  template <class Predicate>
+  int filter(Predicate keep, int ca = 0);
+  /**
+   * @brief Same as filter, the predicate taking the node id
+   * Suited to predicates reading per-node columns (indexed by Node::id):
+   * the predicate is evaluated on consecutive ids into a byte mask.
+   **/
+  template <class Predicate>
+  int filterById(Predicate keep, int ca = 0);
+
   void setFalse();
 
   // private:
@@ -220,46 +547,179 @@ class ComponentTree {
   std::vector<TOffset> merge_pixelsFalseNodes(Node *tree);
   void merge_pixels(Node *tree, std::vector<TOffset> &res);
 
+  // whether the se (its points) fits in the pixels, resp. in the node
   bool isInclude(FlatSE &se, Node::ContainerPixels &pixels);
-
+  bool isInclude(FlatSE &se, Node *n);
+
+  // volume of a node above its father (above 0 for the root)
+  static long double nodeVolume(const Node *n);
+  // squared euclidean distance transform of the n values of f (spaced by
+  // step), lower envelope of parabolas (Felzenszwalb and Huttenlocher):
+  // stored in place through d, or only its maximum returned if d is 0
+  // (v, z and d holding n + 1 elements)
+  static double squaredDistanceLine(double *f, int n, int step, int *v,
+                                    double *z, double *d);
+  // bin of a value for sorted thresholds (see patternSpectrum)
+  static int spectrumBin(const std::vector<long double> &thresholds,
+                         long double value);
+
+  // node of a pixel in constant time (0 outside the image)
   Node *coordToNode(TCoord x, TCoord y);
   Node *coordToNode(TCoord x, TCoord y, TCoord z);
+  // nodes of several pixels (res is resized)
+  void coordToNode(const std::vector<Point<TCoord> > &points,
+                   std::vector<Node *> &res);
 
   Node *indexedCoordToNode(TCoord x, TCoord y, TCoord z,
                            std::vector<Node *> &nodes);
+  // node of each pixel, indexed by offset (see nodeIds, 4 times smaller)
   std::vector<Node *> indexedNodes();
 
   Node *offsetToNode(TOffset offset);
+  void offsetToNode(const std::vector<TOffset> &offsets,
+                    std::vector<Node *> &res);
+
+  // output level of each node (indexed by Node::id) for a filtering rule
+  void computeLevels(ConstructionDecision decision,
+                     std::vector<int> &levels) const;
+  // same with the activity of each node given by active (indexed by Node::id)
+  void computeLevels(ConstructionDecision decision,
+                     const std::vector<bool> &active,
+                     std::vector<int> &levels) const;
+  // level and kept state of a node from the ones of its father (kept is
+  // given for MAX)
+  static void nodeLevel(ConstructionDecision decision, const Node *n,
+                        bool active, int fatherLevel, bool fatherKept,
+                        int &level, bool &kept);
+  // level of a node for MIN, DIRECT or SUBTRACTIVE, from its ancestors
+  // (levels: node id -> level and kept state, completed on the way)
+  int ancestorsLevel(ConstructionDecision decision, Node *n,
+                     std::unordered_map<int, std::pair<int, bool> > &levels);
+  void constructImageLevels(T *res, const std::vector<int> &levels) const;
+  // buffer of res, resized to size if needed
+  template <class TVal>
+  static TVal *outputBuffer(Image<TVal> &res, const TSize *size);
+  // res[offset] = value(offset) for all the pixels, by bands of rows shared
+  // among the threads of m_scheduler
+  template <class TVal, class F>
+  void renderImage(TVal *res, const F &value) const;
+  // value of each node (indexed by Node::id) in the image of each spec
+  template <class TVal, class TSel, class TLimit>
+  void attributeTables(const std::vector<AttributeImageSpec> &specs,
+                       std::vector<std::vector<TVal> > &tables);
+  // value of each node in each plane of a signature
+  template <class TVal>
+  void signatureTables(Attribute value_attribute,
+                       const std::vector<int> &thresholds,
+                       std::vector<std::vector<TVal> > &tables);
+  // values converted to TOut (see ValueRange)
+  template <class TVal, class TOut>
+  static void quantizeValues(const std::vector<TVal> &values,
+                             const ValueRange &range, std::vector<TOut> &res);
+  // res[i][offset] = tables[i][node id of offset], in one scan of the pixels
+  // (each row being written in all the images)
+  template <class TVal>
+  void renderTables(TVal *const *res,
+                    const std::vector<std::vector<TVal> > &tables);
+  // res[offset * channels + i] = tables[i][node id of offset]
+  template <class TVal>
+  void renderInterleaved(TVal *res,
+                         const std::vector<std::vector<TVal> > &tables);
+  // renderRow(row) for all the rows, by bands shared among the threads
+  template <class F>
+  void renderBands(const F &renderRow) const;
+  // res[roi offset] = value(image offset) for the pixels of roi inside the
+  // image (the others are 0)
+  template <class TVal, class F>
+  void renderRegion(TVal *res, const ImageRegion &roi, const F &value);
+  // value of the node select(n) at the pixels of roi, once per node n
+  template <class TVal, class Select>
+  void renderRegionAttribute(TVal *res, const ImageRegion &roi,
+                             Attribute value_attribute, const Select &select);
+
+  // node whose value is rendered at the pixels of n, for a selection rule
+  template <class TSel>
+  Node *selectMin(Node *n, Attribute selection_attribute);
+  template <class TSel>
+  Node *selectMax(Node *n, Attribute selection_attribute);
+  template <class TSel, class TLimit>
+  Node *selectMin(Node *n, Attribute selection_attribute,
+                  Attribute limit_attribute, TLimit limit_min,
+                  TLimit limit_max);
+  template <class TSel, class TLimit>
+  Node *selectMax(Node *n, Attribute selection_attribute,
+                  Attribute limit_attribute, TLimit limit_min,
+                  TLimit limit_max);
+  template <class TLimit>
+  Node *selectDirect(Node *n, Attribute limit_attribute, TLimit limit_min);
+  // selected node of each node (indexed by Node::id) for a selection rule,
+  // in one pass over m_nodes (the limit attribute is used if limited)
+  template <class TSel, class TLimit>
+  void selectNodes(ConstructionDecision selection_rule,
+                   Attribute selection_attribute, bool limited,
+                   Attribute limit_attribute, TLimit limit_min,
+                   TLimit limit_max, std::vector<int> &selected);
+  // same from the columns of the attributes (limit is 0 if not limited,
+  // value is not read for DIRECT)
+  template <class TSel, class TLimit>
+  void selectNodes(ConstructionDecision selection_rule, const TSel *value,
+                   const TLimit *limit, TLimit limit_min, TLimit limit_max,
+                   std::vector<int> &selected);
+  // value of the selected node of each node, at the pixels of the node
+  template <class TVal>
+  void renderSelected(TVal *res, Attribute value_attribute,
+                      const std::vector<int> &selected);
 
   void constructImageMin(Image<T> &res);
   void constructImageMax(Image<T> &res);
   void constructImageDirect(Image<T> &res);
   void constructImageDirectExpe(Image<T> &res);
 
+  // ComputedAttributes needed to read an attribute
+  static int attributeDependencies(Attribute attribute_id);
+
+  /**
+   * @brief Value of an attribute, computed on the first access
+   **/
   template <class TVal>
-  TVal getAttribute(Node *n, Attribute attribute_id);
+  TVal getAttribute(Node *n, Attribute attribute_id) {
+    int ca = attributeDependencies(attribute_id);
+    if ((m_computed & ca) != ca) computeAttributes(ca);
+    return attributeValue<TVal>(n, attribute_id);
+  }
+  // Same without computing the attribute (it must be available)
+  template <class TVal>
+  TVal attributeValue(Node *n, Attribute attribute_id);
+  // column of the attribute A (attributeValue is specialised on the constant
+  // A, its switch being folded), or of the attribute_id in
+  // [A, INSCRIBED_RADIUS]
+  template <class TVal, int A>
+  void fillAttributeValues(Attribute attribute_id, TVal *column,
+                           std::integral_constant<int, A>);
+  template <class TVal>
+  void fillAttributeValues(Attribute, TVal *,
+                           std::integral_constant<int, INSCRIBED_RADIUS + 1>) {}
   template <class TVal, class TSel>
-  void constructImageAttributeMin(Image<TVal> &res, Attribute value_attribute,
+  void constructImageAttributeMin(TVal *res, Attribute value_attribute,
                                   Attribute selection_attribute);
   template <class TVal, class TSel>
-  void constructImageAttributeMax(Image<TVal> &res, Attribute value_attribute,
+  void constructImageAttributeMax(TVal *res, Attribute value_attribute,
                                   Attribute selection_attribute);
   template <class TVal>
-  void constructImageAttributeDirect(Image<TVal> &res,
-                                     Attribute value_attribute);
+  void constructImageAttributeDirect(TVal *res, Attribute value_attribute);
 
   template <class TVal, class TSel, class TLimit>
-  void constructImageAttributeMin(Image<TVal> &res, Attribute value_attribute,
+  void constructImageAttributeMin(TVal *res, Attribute value_attribute,
                                   Attribute selection_attribute,
                                   Attribute limit_attribute, TLimit limit_min,
                                   TLimit limit_max);
   template <class TVal, class TSel, class TLimit>
-  void constructImageAttributeMax(Image<TVal> &res, Attribute value_attribute,
+  void constructImageAttributeMax(TVal *res, Attribute value_attribute,
                                   Attribute selection_attribute,
                                   Attribute limit_attribute, TLimit limit_min,
                                   TLimit limit_max);
   template <class TVal, class TLimit>
-  void constructImageAttributeDirect(Image<TVal> &res,
+  void constructImageAttributeDirect(TVal *res,
                                      Attribute value_attribute,
                                      Attribute limit_attribute,
                                      TLimit limit_min, TLimit limit_max);
@@ -270,21 +730,56 @@ class ComponentTree {
   // Internal structure
   // root node
   Node *m_root;
+  // all nodes, indexed by Node::id (a father always precedes its sons)
+  std::vector<Node *> m_nodes;
+  // Node::id of the node of each pixel, indexed by offset
+  std::vector<int32_t> m_nodeIds;
+  // shape descriptors, indexed by Node::id (empty unless MOMENTS computed)
+  std::vector<ShapeMoments> m_moments;
+  // grey-level histograms, indexed by Node::id (empty unless HISTOGRAM)
+  std::vector<GreyLevelHistogram> m_histograms;
+  // number of bins of the histograms (at most one bin per grey level)
+  int m_histogramBins;
   // TSize *m_size;
 
   // original data
   Image<T> m_img;
 
-  // STATUS image
-  Image<int> STATUS;
-
-  // max-tree index
-  IndexType index;
-
   // hmin
   int hMin;
   int hToIndex(int h) { return h - hMin; }
   int indexToH(int h) { return h + hMin; }
+
+  // strategy kept to compute attributes on demand (its construction buffers,
+  // about 4 + sizeof(T) + 8 bytes per pixel, are released once the tree is
+  // built)
+  ComponentTreeStrategy<T> *m_strategy;
+  // ComputedAttributes mask of the available attributes
+  int m_computed;
+  // delta used for MSER (and radius of the OTSU neighborhood)
+  unsigned int m_delta;
+  // scheduler of the parallel attribute computation (0 if sequential)
+  TaskScheduler *m_scheduler;
+  // derived attributes finalised by AttributeKernels
+  bool m_vectorized;
+  // extinction values of m_extinctionAttribute and dynamics, indexed by
+  // Node::id (empty unless EXTINCTION / DYNAMICS computed)
+  std::vector<long double> m_extinction;
+  std::vector<long double> m_dynamics;
+  Attribute m_extinctionAttribute;
+  // radius of the largest included ball, indexed by Node::id (empty unless
+  // INSCRIBED_RADIUS computed)
+  std::vector<int> m_inscribedRadius;
+
+  // bands of rows rendered by a task have about RENDER_GRAIN pixels
+  static const int RENDER_GRAIN = 1 << 16;
+  static const int DEFAULT_ATTRIBUTES =
+      ComputedAttributes::AREA | ComputedAttributes::CONTRAST |
+      ComputedAttributes::VOLUME | ComputedAttributes::COMP_LEXITY_ACITY |
+      ComputedAttributes::BOUNDING_BOX | ComputedAttributes::SUB_NODES;
+  static const int DEFAULT_DELTA_ATTRIBUTES =
+      ComputedAttributes::AREA | ComputedAttributes::AREA_DERIVATIVES |
+      ComputedAttributes::CONTRAST | ComputedAttributes::VOLUME;
 };
 
 /** @brief Abstract class for strategy to compute component tree
@@ -298,6 +793,8 @@ class ComponentTreeStrategy {
 
   virtual Node *computeTree() = 0;
   virtual void computeAttributes(Node *tree) = 0;
+  virtual void computeAttributes(Node *tree, ComputedAttributes ca,
+                                 unsigned int delta) = 0;
 };
 
 /** @brief Salembier recursive implementation
@@ -307,13 +804,17 @@ template <class T>
 class SalembierRecursiveImplementation : public ComponentTreeStrategy<T> {
  public:
   SalembierRecursiveImplementation(ComponentTree<T> *parent, FlatSE &connexity)
-      : m_parent(parent) {
+      : contourComputed(false),
+        contourPixelsSaved(false),
+        gradientComputed(false),
+        m_parent(parent) {
     this->totalNodes = 0;
     this->init(m_parent->m_img, connexity);
   }
   ~SalembierRecursiveImplementation() { delete[] hq; }
 
   Node *computeTree();
+  void addAccumulator(AccumulatorBase *acc) { accumulators.push_back(acc); }
   void computeAttributes(Node *tree);
   void computeAttributes(Node *tree, unsigned int delta);
   void computeAttributes(Node *tree, ComputedAttributes ca, unsigned int delta);
@@ -340,6 +841,14 @@ class SalembierRecursiveImplementation : public ComponentTreeStrategy<T> {
 
   int computeBoundingBox(Node *tree);
 
+  // Per-node computations, shared by the sequential and parallel passes
+  void mergeSons(Node *tree, int ca);
+  void nodeAreaDerivative(Node *tree);
+  void nodeMSER(Node *tree, unsigned int delta);
+  void nodeStatistics(Node *tree);
+  void nodeBorderGradient(Node *tree);
+  void nodeComplexityAndCompacity(Node *n);
+
   int hToIndex(int h) { return h - hMin; }
   int indexToH(int h) { return h + hMin; }
 
@@ -349,12 +858,33 @@ class SalembierRecursiveImplementation : public ComponentTreeStrategy<T> {
   inline int flood(int m);
   void link_node(Node *tree, Node *child);
   Node *new_node(int h, int n);
+  void orderNodes(Node *root);
+  void computeGradient();
+
+  void computeAttributesParallel(int ca, unsigned int delta,
+                                 TaskScheduler &scheduler);
+  void mergeSubtree(Node *tree, int ca);
+  void mergeSubtreeParallel(Node *tree, int ca, const std::vector<int> &sizes,
+                            TaskScheduler &scheduler);
+  // subtrees of at most PARALLEL_GRAIN nodes are computed sequentially
+  static const int PARALLEL_GRAIN = 4096;
+
+  void computeAttributesVectorized(int ca, TaskScheduler *scheduler);
+  void finalizeBlock(int ca, std::size_t first, std::size_t last);
+  void finalizeDerivativeBlock(std::size_t first, std::size_t last);
+  static const int VECTORIZED_ATTRIBUTES =
+      ComputedAttributes::OTSU | ComputedAttributes::AREA_DERIVATIVES |
+      ComputedAttributes::COMP_LEXITY_ACITY;
 
   void init(Image<T> &img, FlatSE &connexity);
+  // bordered image, STATUS image, hierarchical queue and level index are
+  // only used by the flooding
+  void releaseConstructionBuffers();
 
   // members
   Image<T> imBorder;
   Image<T> imGradient;
+  FlatSE connexity;
   FlatSE se;
   TSize oriSize[3];
 
@@ -377,9 +907,15 @@ class SalembierRecursiveImplementation : public ComponentTreeStrategy<T> {
 
   int totalNodes;
 
+  // contour length and border pixels are computed at most once
+  bool contourComputed;
+  bool contourPixelsSaved;
+  bool gradientComputed;
+
   Image<int> STATUS;
   vector<int> number_nodes;
   vector<bool> node_at_level;
+  vector<AccumulatorBase *> accumulators;
   // For now, container for accessing nodes by level and cc number
   // typedef std::map <T, std::map<TLabel,  Node *> > IndexType;
   // typedef Node *** IndexType;
@@ -6,12 +6,16 @@
  * Copyright (©) 2022-2023  Cyril Meyer
  */
 
+#include <algorithm>
+#include <cmath>
 #include <functional>
 #include <iostream>
 #include <map>
 #include <queue>
 #include <set>
 #include <stack>
+#include <tuple>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -25,55 +29,247 @@ using std::map;
 using std::vector;
 
 template <class T>
-ComponentTree<T>::ComponentTree(Image<T>& img) : m_root(0), m_img(img) {
+ComponentTree<T>::ComponentTree(Image<T>& img)
+    : m_root(0),
+      m_histogramBins(256),
+      m_img(img),
+      m_computed(0),
+      m_delta(1),
+      m_scheduler(0),
+      m_vectorized(false),
+      m_extinctionAttribute(AREA) {
   FlatSE connexity;
   connexity.make2DN8();
-  SalembierRecursiveImplementation<T> strategy(this, connexity);
+  m_strategy = new SalembierRecursiveImplementation<T>(this, connexity);
 
-  m_root = strategy.computeTree();
-  strategy.computeAttributes(m_root);
+  m_root = m_strategy->computeTree();
+  computeAttributes(DEFAULT_ATTRIBUTES);
 }
 
 template <class T>
 ComponentTree<T>::ComponentTree(Image<T>& img, FlatSE& connexity)
-    : m_root(0), m_img(img) {
-  SalembierRecursiveImplementation<T> strategy(this, connexity);
-
-  m_root = strategy.computeTree();
-  strategy.computeAttributes(m_root);
+    : m_root(0),
+      m_histogramBins(256),
+      m_img(img),
+      m_computed(0),
+      m_delta(1),
+      m_scheduler(0),
+      m_vectorized(false),
+      m_extinctionAttribute(AREA) {
+  m_strategy = new SalembierRecursiveImplementation<T>(this, connexity);
+
+  m_root = m_strategy->computeTree();
+  computeAttributes(DEFAULT_ATTRIBUTES);
 }
 
 template <class T>
 ComponentTree<T>::ComponentTree(Image<T>& img, FlatSE& connexity,
                                 unsigned int delta)
-    : m_root(0), m_img(img) {
-  SalembierRecursiveImplementation<T> strategy(this, connexity);
-
-  m_root = strategy.computeTree();
-  strategy.computeAttributes(m_root, delta);
+    : m_root(0),
+      m_histogramBins(256),
+      m_img(img),
+      m_computed(0),
+      m_delta(delta),
+      m_scheduler(0),
+      m_vectorized(false),
+      m_extinctionAttribute(AREA) {
+  m_strategy = new SalembierRecursiveImplementation<T>(this, connexity);
+
+  m_root = m_strategy->computeTree();
+  computeAttributes(DEFAULT_DELTA_ATTRIBUTES);
 }
 
 template <class T>
 ComponentTree<T>::ComponentTree(Image<T>& img, FlatSE& connexity,
                                 ComputedAttributes ca, unsigned int delta)
-    : m_root(0),
-      m_img(img)
+    : ComponentTree(img, connexity, ca, delta,
+                    std::vector<AccumulatorBase*>()) {}
+
+template <class T>
+ComponentTree<T>::ComponentTree(Image<T>& img, FlatSE& connexity,
+                                ComputedAttributes ca, unsigned int delta,
+                                int histogramBins)
+    : ComponentTree(img, connexity, ca, delta, std::vector<AccumulatorBase*>(),
+                    histogramBins) {}
 
-{
-  SalembierRecursiveImplementation<T> strategy(this, connexity);
+template <class T>
+ComponentTree<T>::ComponentTree(
+    Image<T>& img, FlatSE& connexity, ComputedAttributes ca,
+    unsigned int delta, const std::vector<AccumulatorBase*>& accumulators,
+    int histogramBins)
+    : m_root(0),
+      m_histogramBins(histogramBins),
+      m_img(img),
+      m_computed(0),
+      m_delta(delta),
+      m_scheduler(0),
+      m_vectorized(false),
+      m_extinctionAttribute(AREA) {
+  SalembierRecursiveImplementation<T>* strategy =
+      new SalembierRecursiveImplementation<T>(this, connexity);
+  m_strategy = strategy;
+  for (int i = 0; i < accumulators.size(); i++)
+    strategy->addAccumulator(accumulators[i]);
+
+  // raw moments and histograms are accumulated while flooding
+  Accumulator<MomentsAccumulator> moments;
+  if (ca & ComputedAttributes::MOMENTS) strategy->addAccumulator(&moments);
+  Accumulator<HistogramAccumulator> histograms;
+  if (ca & ComputedAttributes::HISTOGRAM) {
+    histograms.accumulator() =
+        HistogramAccumulator(m_histogramBins, img.getMin(), img.getMax());
+    strategy->addAccumulator(&histograms);
+  }
 
-  m_root = strategy.computeTree();
+  m_root = m_strategy->computeTree();
 
-  if (ca & ComputedAttributes::OTSU) {
-    computeNeighborhoodAttributes(delta);
+  if (ca & ComputedAttributes::MOMENTS) {
+    m_moments.swap(moments.results());
+    m_computed |= ComputedAttributes::MOMENTS;
+  }
+  if (ca & ComputedAttributes::HISTOGRAM) {
+    m_histograms.swap(histograms.results());
+    m_computed |= ComputedAttributes::HISTOGRAM;
   }
 
-  strategy.computeAttributes(m_root, ca, delta);
+  computeAttributes(ca);
 }
 
 template <class T>
 ComponentTree<T>::~ComponentTree() {
   erase_tree();
+  delete m_strategy;
+  delete m_scheduler;
+}
+
+template <class T>
+void ComponentTree<T>::setNumberOfThreads(int nbThreads) {
+  delete m_scheduler;
+  m_scheduler = 0;
+  if (nbThreads != 1) {
+    m_scheduler = new TaskScheduler(nbThreads);
+    if (m_scheduler->getNumberOfThreads() == 1) {
+      delete m_scheduler;
+      m_scheduler = 0;
+    }
+  }
+}
+
+template <class T>
+int ComponentTree<T>::attributeDependencies(Attribute attribute_id) {
+  switch (attribute_id) {
+    case H:
+      return 0;
+    case AREA:
+      return ComputedAttributes::AREA;
+    case AREA_D_AREAN_H:
+    case AREA_D_AREAN_H_D:
+    case AREA_D_H:
+    case AREA_D_AREAN:
+    case MSER:
+    case AREA_D_DELTA_H:
+    case AREA_D_DELTA_AREAF:
+      return ComputedAttributes::AREA_DERIVATIVES;
+    case MEAN:
+    case VARIANCE:
+    case MEAN_NGHB:
+    case VARIANCE_NGHB:
+    case OTSU:
+      return ComputedAttributes::OTSU;
+    case CONTRAST:
+      return ComputedAttributes::CONTRAST;
+    case VOLUME:
+      return ComputedAttributes::VOLUME;
+    case MGB:
+      return ComputedAttributes::BORDER_GRADIENT;
+    case CONTOUR_LENGTH:
+    case COMPLEXITY:
+    case COMPACITY:
+      return ComputedAttributes::COMP_LEXITY_ACITY;
+    case INERTIA:
+    case ELONGATION:
+    case ORIENTATION:
+    case HU_1:
+    case HU_2:
+    case HU_3:
+    case HU_4:
+    case HU_5:
+    case HU_6:
+    case HU_7:
+      return ComputedAttributes::MOMENTS;
+    case MEDIAN:
+    case ENTROPY:
+    case OTSU_HISTOGRAM:
+      return ComputedAttributes::HISTOGRAM;
+    case EXTINCTION:
+      return ComputedAttributes::EXTINCTION;
+    case DYNAMICS:
+      return ComputedAttributes::DYNAMICS;
+    case INSCRIBED_RADIUS:
+      return ComputedAttributes::INSCRIBED_RADIUS;
+  }
+  return 0;
+}
+
+template <class T>
+int ComponentTree<T>::computeAttributes(int ca) {
+  int missing = ca & ~m_computed;
+  if (missing == 0 || m_root == 0) return 0;
+
+  // these attributes are derived from the area
+  if (missing & (ComputedAttributes::AREA_DERIVATIVES |
+                 ComputedAttributes::OTSU | ComputedAttributes::VOLUME |
+                 ComputedAttributes::COMP_LEXITY_ACITY))
+    missing |= ComputedAttributes::AREA & ~m_computed;
+  // dynamics are the extinction values of the height of the branches
+  if (missing & ComputedAttributes::DYNAMICS)
+    missing |= ComputedAttributes::CONTRAST & ~m_computed;
+  // the inscribed radius is bounded by the area and the bounding box
+  if (missing & ComputedAttributes::INSCRIBED_RADIUS)
+    missing |= (ComputedAttributes::AREA | ComputedAttributes::BOUNDING_BOX) &
+               ~m_computed;
+
+  if (missing & ComputedAttributes::OTSU) {
+    computeNeighborhoodAttributes(m_delta);
+  }
+  if (missing & ComputedAttributes::MOMENTS) {
+    Accumulator<MomentsAccumulator> moments;
+    accumulate(moments);
+    m_moments.swap(moments.results());
+  }
+  if (missing & ComputedAttributes::HISTOGRAM) {
+    int hMax = m_root->ori_h;
+    for (int i = 0; i < m_nodes.size(); i++)
+      hMax = std::max(hMax, m_nodes[i]->ori_h);
+    Accumulator<HistogramAccumulator> histograms(
+        HistogramAccumulator(m_histogramBins, m_root->ori_h, hMax));
+    accumulate(histograms);
+    m_histograms.swap(histograms.results());
+  }
+
+  m_strategy->computeAttributes(m_root, (ComputedAttributes)missing, m_delta);
+  // extinction values and inscribed radii depend on other attributes
+  int derived = missing & (ComputedAttributes::EXTINCTION |
+                           ComputedAttributes::DYNAMICS |
+                           ComputedAttributes::INSCRIBED_RADIUS);
+  m_computed |= missing & ~derived;
+
+  if (derived & ComputedAttributes::EXTINCTION)
+    computeExtinctionValues(m_extinctionAttribute);
+  if (derived & ComputedAttributes::DYNAMICS) {
+    // height of the branch above the level of the father
+    std::vector<long double> height(m_nodes.size());
+    for (int i = 0; i < m_nodes.size(); i++) {
+      Node* n = m_nodes[i];
+      height[i] = n->contrast;
+      if (n->father != n) height[i] += n->h - n->father->h;
+    }
+    m_dynamics = computeExtinction(height);
+    m_computed |= ComputedAttributes::DYNAMICS;
+  }
+  if (derived & ComputedAttributes::INSCRIBED_RADIUS) computeInscribedRadius();
+
+  return 0;
 }
 
 template <class T>
@@ -108,11 +304,14 @@ int ComponentTree<T>::computeNeighborhoodAttributes(int r) {
 
         if (m_img.isPosValid(q)) {
           if (active(q) == true) {
+            // original level, m_img may hold a reconstruction
+            // (constructImageOptimized)
+            int value = m_nodes[m_nodeIds[m_img.getOffset(q)]]->ori_h;
             n->area_nghb += 1;
-            n->sum_nghb += m_img(q);
-            n->sum_square_nghb += m_img(q) * m_img(q);
+            n->sum_nghb += value;
+            n->sum_square_nghb += value * value;
 
-            ndg.push_back(m_img(q));
+            ndg.push_back(value);
 
             active(q) = false;
           }
@@ -136,6 +335,345 @@ int ComponentTree<T>::computeNeighborhoodAttributes(int r) {
   return 0;
 }
 
+template <class T>
+int ComponentTree<T>::accumulate(AccumulatorBase& acc) {
+  for (int i = 0; i < m_nodes.size(); i++) {
+    Node* n = m_nodes[i];
+    acc.newNode(n);
+    for (int j = 0; j < n->pixels.size(); j++)
+      acc.addPixel(n, m_img.getCoord(n->pixels[j]), n->ori_h);
+  }
+  acc.merge(m_nodes);
+
+  return 0;
+}
+
+template <class T>
+long double ComponentTree<T>::getQuantile(Node* n, long double q) {
+  computeAttributes(ComputedAttributes::HISTOGRAM);
+  return m_histograms[n->id].quantile(q);
+}
+
+template <class T>
+std::vector<long double> ComponentTree<T>::computeExtinction(
+    const std::vector<long double>& column) {
+  int size = m_nodes.size();
+  // highest value of the branch of each node and leaf ending it
+  std::vector<long double> branch(column);
+  std::vector<int> leaf(size);
+  // extinction values of the leaves
+  std::vector<long double> extinction(size, 0);
+
+  // sons before fathers
+  for (int i = size - 1; i >= 0; i--) {
+    Node* n = m_nodes[i];
+    leaf[i] = i;
+    if (n->childs.empty()) continue;
+
+    Node* dominant = n->childs[0];
+    for (int c = 1; c < n->childs.size(); c++)
+      if (branch[n->childs[c]->id] > branch[dominant->id])
+        dominant = n->childs[c];
+
+    for (int c = 0; c < n->childs.size(); c++) {
+      Node* son = n->childs[c];
+      if (son != dominant) extinction[leaf[son->id]] = branch[son->id];
+    }
+    leaf[i] = leaf[dominant->id];
+    branch[i] = std::max(branch[i], branch[dominant->id]);
+  }
+  if (size > 0) extinction[leaf[0]] = branch[0];
+
+  std::vector<long double> res(size);
+  for (int i = 0; i < size; i++) res[i] = extinction[leaf[i]];
+  return res;
+}
+
+template <class T>
+int ComponentTree<T>::computeExtinctionValues(Attribute attribute_id) {
+  m_extinction = computeExtinction(attributeColumn(attribute_id));
+  m_extinctionAttribute = attribute_id;
+  m_computed |= ComputedAttributes::EXTINCTION;
+  return 0;
+}
+
+template <class T>
+int ComponentTree<T>::computeInscribedRadius() {
+  if (m_root == 0) return 0;
+  computeAttributes(ComputedAttributes::AREA |
+                    ComputedAttributes::BOUNDING_BOX);
+
+  int size = m_nodes.size();
+  bool is3D = m_img.getSizeZ() > 1;
+  TSize sx = m_img.getSizeX();
+  TSize sxy = sx * m_img.getSizeY();
+
+  // subtrees are intervals of the depth-first order: the pixel p belongs to
+  // the node i iff first[i] <= rank[p] < first[i] + count[i]
+  std::vector<int> first(size), count(size, 1);
+  for (int i = size - 1; i > 0; i--) count[m_nodes[i]->father->id] += count[i];
+  first[0] = 0;
+  for (int i = 0; i < size; i++) {
+    int next = first[i] + 1;
+    Node* n = m_nodes[i];
+    for (int j = 0; j < n->childs.size(); j++) {
+      first[n->childs[j]->id] = next;
+      next += count[n->childs[j]->id];
+    }
+  }
+  std::vector<int> rank(m_nodeIds.size());
+  for (TOffset p = 0; p < rank.size(); p++) rank[p] = first[m_nodeIds[p]];
+
+  // number of points of the balls of radius 0, 1, ...
+  std::vector<int64_t> ballSize;
+  auto isqrt = [](int64_t a) {
+    int64_t r = (int64_t)std::sqrt((double)a);
+    while (r * r > a) r--;
+    while ((r + 1) * (r + 1) <= a) r++;
+    return r;
+  };
+  auto ballPoints = [&](int r) {
+    while (ballSize.size() <= r) {
+      int64_t radius = ballSize.size(), points = 0;
+      for (int64_t x = -radius; x <= radius; x++) {
+        int64_t rx = radius * radius - x * x;
+        if (!is3D) {
+          points += 2 * isqrt(rx) + 1;
+          continue;
+        }
+        for (int64_t y = -isqrt(rx); y * y <= rx; y++)
+          points += 2 * isqrt(rx - y * y) + 1;
+      }
+      ballSize.push_back(points);
+    }
+    return ballSize[r];
+  };
+
+  // squared distance to the background in the bounding box of a node,
+  // padded with background
+  std::vector<double> f, z, d;
+  std::vector<int> v;
+
+  m_inscribedRadius.assign(size, 0);
+  for (int i = size - 1; i >= 0; i--) {
+    Node* n = m_nodes[i];
+    // the balls included in the sons are included in the node
+    int radius = 0;
+    for (int j = 0; j < n->childs.size(); j++)
+      radius = std::max(radius, m_inscribedRadius[n->childs[j]->id]);
+
+    // a ball of radius r spans 2r + 1 pixels along each axis
+    TSize wx = n->xmax - n->xmin + 1;
+    TSize wy = n->ymax - n->ymin + 1;
+    TSize wz = n->zmax - n->zmin + 1;
+    TSize w = is3D ? std::min(std::min(wx, wy), wz) : std::min(wx, wy);
+    if (radius >= (w - 1) / 2 || ballPoints(radius + 1) > n->area) {
+      m_inscribedRadius[i] = radius;
+      continue;
+    }
+
+    TSize px = wx + 2, py = wy + 2, pz = is3D ? wz + 2 : 1;
+    int zb = is3D ? 1 : 0;
+    f.assign(px * py * pz, 0);
+    TSize line = std::max(std::max(px, py), pz);
+    if (v.size() <= line) {
+      v.resize(line + 1);
+      z.resize(line + 1);
+      d.resize(line + 1);
+    }
+
+    // distance along the columns, sweeping whole rows
+    for (TSize k = zb; k < zb + wz; k++) {
+      double* plane = &f[px * py * k];
+      for (TSize j = 1; j <= wy; j++) {
+        double* row = plane + px * j + 1;
+        const double* previous = row - px;
+        const int* ranks = &rank[n->xmin + (n->ymin + j - 1) * sx +
+                                 (n->zmin + k - zb) * sxy];
+        for (TSize l = 0; l < wx; l++)
+          if ((unsigned)(ranks[l] - first[i]) < (unsigned)count[i])
+            row[l] = previous[l] + 1;
+      }
+      for (TSize j = wy; j >= 1; j--) {
+        double* row = plane + px * j + 1;
+        const double* next = row + px;
+        for (TSize l = 0; l < wx; l++)
+          if (row[l] != 0) row[l] = std::min(row[l], next[l] + 1);
+      }
+      for (TSize l = px; l < px * (py - 1); l++) plane[l] *= plane[l];
+    }
+    // then along the slices and the rows, only the maximum of the last
+    // transform being needed: the ball of radius r centred on p is included
+    // iff r^2 < f(p), and rows below the current maximum are skipped
+    if (is3D)
+      for (TSize j = 1; j <= wy; j++)
+        for (TSize l = 1; l <= wx; l++)
+          squaredDistanceLine(&f[l + px * j], pz, px * py, &v[0], &z[0],
+                              &d[0]);
+    double maxDist = (double)(radius + 1) * (radius + 1);
+    for (TSize k = zb; k < zb + wz; k++)
+      for (TSize j = 1; j <= wy; j++) {
+        double* row = &f[px * (j + py * k)];
+        if (*std::max_element(row, row + px) > maxDist)
+          maxDist = std::max(
+              maxDist, squaredDistanceLine(row, px, 1, &v[0], &z[0], 0));
+      }
+    int r = isqrt((int64_t)maxDist);
+    if ((double)r * r == maxDist) r--;
+    m_inscribedRadius[i] = std::max(radius, r);
+  }
+
+  m_computed |= ComputedAttributes::INSCRIBED_RADIUS;
+  return 0;
+}
+
+template <class T>
+std::vector<long double> ComponentTree<T>::attributeColumn(
+    Attribute attribute_id) {
+  computeAttributes(attributeDependencies(attribute_id));
+
+  std::vector<long double> column;
+  attributeValues(attribute_id, column);
+  return column;
+}
+
+template <class T>
+template <class TVal>
+void ComponentTree<T>::attributeValues(Attribute attribute_id,
+                                       std::vector<TVal>& column) {
+  column.resize(m_nodes.size());
+  if (!column.empty())
+    fillAttributeValues(attribute_id, &column[0],
+                        std::integral_constant<int, H>());
+}
+
+template <class T>
+template <class TVal, int A>
+void ComponentTree<T>::fillAttributeValues(Attribute attribute_id,
+                                           TVal* column,
+                                           std::integral_constant<int, A>) {
+  if (attribute_id != A) {
+    fillAttributeValues(attribute_id, column,
+                        std::integral_constant<int, A + 1>());
+    return;
+  }
+  Node* const* nodes = &m_nodes[0];
+  int size = m_nodes.size();
+  for (int i = 0; i < size; i++)
+    column[i] = attributeValue<TVal>(nodes[i], (Attribute)A);
+}
+
+template <class T>
+long double ComponentTree<T>::nodeVolume(const Node* n) {
+  int fatherLevel = (n->father == n) ? 0 : n->father->h;
+  return (long double)n->area * (n->h - fatherLevel);
+}
+
+template <class T>
+double ComponentTree<T>::squaredDistanceLine(double* f, int n, int step,
+                                             int* v, double* z, double* d) {
+  const double inf = std::numeric_limits<double>::infinity();
+  // lower envelope of the parabolas rooted at (q, f(q))
+  int k = 0;
+  v[0] = 0;
+  z[0] = -inf;
+  z[1] = inf;
+  for (int q = 1; q < n; q++) {
+    double fq = f[q * step] + (double)q * q;
+    double s;
+    while (true) {
+      int p = v[k];
+      s = (fq - f[p * step] - (double)p * p) / (2.0 * (q - p));
+      if (s > z[k]) break;
+      k--;
+    }
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = inf;
+  }
+
+  if (d == 0) {
+    // the envelope is convex between two intersections
+    double res = 0;
+    for (int i = 0; i <= k; i++) {
+      double first = std::max(0.0, std::ceil(z[i]));
+      double last = std::min(n - 1.0, std::floor(z[i + 1]));
+      if (first > last) continue;
+      double p = v[i], fp = f[v[i] * step];
+      res = std::max(res, std::max((first - p) * (first - p),
+                                   (last - p) * (last - p)) + fp);
+    }
+    return res;
+  }
+
+  k = 0;
+  for (int q = 0; q < n; q++) {
+    while (z[k + 1] < q) k++;
+    double dq = q - v[k];
+    d[q] = dq * dq + f[v[k] * step];
+  }
+  for (int q = 0; q < n; q++) f[q * step] = d[q];
+  return 0;
+}
+
+template <class T>
+int ComponentTree<T>::spectrumBin(const std::vector<long double>& thresholds,
+                                  long double value) {
+  return std::upper_bound(thresholds.begin(), thresholds.end(), value) -
+         thresholds.begin();
+}
+
+template <class T>
+std::vector<long double> ComponentTree<T>::patternSpectrum(
+    const std::vector<long double>& column,
+    const std::vector<long double>& thresholds) {
+  if (column.size() != m_nodes.size() ||
+      !std::is_sorted(thresholds.begin(), thresholds.end()))
+    return std::vector<long double>();
+  computeAttributes(ComputedAttributes::AREA);
+
+  std::vector<long double> res(thresholds.size() + 1, 0);
+  for (int i = 0; i < m_nodes.size(); i++)
+    res[spectrumBin(thresholds, column[i])] += nodeVolume(m_nodes[i]);
+  return res;
+}
+
+template <class T>
+std::vector<long double> ComponentTree<T>::patternSpectrum(
+    Attribute attribute_id, const std::vector<long double>& thresholds) {
+  return patternSpectrum(attributeColumn(attribute_id), thresholds);
+}
+
+template <class T>
+std::vector<std::vector<long double> > ComponentTree<T>::patternSpectrum(
+    const std::vector<long double>& column1,
+    const std::vector<long double>& thresholds1,
+    const std::vector<long double>& column2,
+    const std::vector<long double>& thresholds2) {
+  if (column1.size() != m_nodes.size() || column2.size() != m_nodes.size() ||
+      !std::is_sorted(thresholds1.begin(), thresholds1.end()) ||
+      !std::is_sorted(thresholds2.begin(), thresholds2.end()))
+    return std::vector<std::vector<long double> >();
+  computeAttributes(ComputedAttributes::AREA);
+
+  std::vector<std::vector<long double> > res(
+      thresholds1.size() + 1,
+      std::vector<long double>(thresholds2.size() + 1, 0));
+  for (int i = 0; i < m_nodes.size(); i++)
+    res[spectrumBin(thresholds1, column1[i])]
+       [spectrumBin(thresholds2, column2[i])] += nodeVolume(m_nodes[i]);
+  return res;
+}
+
+template <class T>
+std::vector<std::vector<long double> > ComponentTree<T>::patternSpectrum(
+    Attribute attribute1, const std::vector<long double>& thresholds1,
+    Attribute attribute2, const std::vector<long double>& thresholds2) {
+  return patternSpectrum(attributeColumn(attribute1), thresholds1,
+                         attributeColumn(attribute2), thresholds2);
+}
+
 template <class T>
 void ComponentTree<T>::erase_tree() {
   int tot = 0;
@@ -157,226 +695,326 @@ void ComponentTree<T>::erase_tree() {
 
 template <class T>
 Image<T>& ComponentTree<T>::constructImageOptimized() {
-  int numberNonActives = 0;
-  if (m_root != 0)
-    if (m_root->active == true) {
-      std::queue<Node*> fifo;
-      std::queue<Node*> fifoChilds;
-      fifo.push(m_root);
-      while (!fifo.empty()) {
-        Node* tmp = fifo.front();
-        fifo.pop();
-
-        for (std::vector<Node*>::iterator it = tmp->childs.begin();
-             it != tmp->childs.end(); ++it) {
-          if ((*it)->active == false) {
-            fifoChilds.push(*it);
-
-            while (!fifoChilds.empty()) {
-              Node* child = fifoChilds.front();
-              fifoChilds.pop();
-
-              for (std::vector<TOffset>::iterator it3 = child->pixels.begin();
-                   it3 != child->pixels.end(); ++it3)
-                m_img(*it3) = (T)tmp->h;
-
-              for (std::vector<Node*>::iterator it2 = child->childs.begin();
-                   it2 != child->childs.end(); ++it2) {
-                fifoChilds.push(*it2);
-              }
-            }
-
-          } else
-            fifo.push(*it);
-        }
-      }
-    } else
-      m_img.fill(T(0));
-  else
-    m_img.fill(T(0));
-
+  constructImage(m_img.getData(), MIN);
   return m_img;
 }
 
-template <class T>
-void ComponentTree<T>::constructImageMin(Image<T>& res) {
-  if (m_root->active == true) {
-    std::queue<Node*> fifo;
-    fifo.push(m_root);
-    while (!fifo.empty()) {
-      Node* tmp = fifo.front();
-      fifo.pop();
+// Filtering rules
+// The output level of each node is computed in one pass over m_nodes
+// (fathers before sons), then written with one scan of the node ids of the
+// pixels:
+// - MIN: a node is kept if it and all its ancestors are active
+// - MAX: a node is kept if it or one of its descendants is active
+// - DIRECT: a node is kept if it is active
+// - SUBTRACTIVE: active nodes are kept, and the grey-level step of the
+//   removed ancestors is subtracted from them
+// A removed node takes the level of its father (0 for the root).
 
-      // update pixels contained in the node
-      for (std::vector<TOffset>::iterator it = tmp->pixels.begin();
-           it != tmp->pixels.end(); ++it)
-        res(*it) = (T)tmp->h;
-
-      for (std::vector<Node*>::iterator it = tmp->childs.begin();
-           it != tmp->childs.end(); ++it) {
-        // if child->active is false, "cut" the subtree and hence search
-        // all pixels of all subnodes
-        if ((*it)->active == false) {
-          std::vector<TOffset> subPixels = merge_pixels(*it);
-          for (std::vector<TOffset>::iterator it = subPixels.begin();
-               it != subPixels.end(); ++it)
-            res(*it) = (T)tmp->h;
-        } else
-          fifo.push(*it);
-      }
-    }
-  } else
-    res.fill(T(0));
+template <class T>
+void ComponentTree<T>::computeLevels(ConstructionDecision decision,
+                                     std::vector<int>& levels) const {
+  std::vector<bool> active(m_nodes.size());
+  for (int i = 0; i < m_nodes.size(); i++) active[i] = m_nodes[i]->active;
+  computeLevels(decision, active, levels);
 }
 
-// Does not work!!!!!
-// TODO: implement construct image Max
 template <class T>
-void ComponentTree<T>::constructImageMax(Image<T>& res) {
-  res.fill(0);
+void ComponentTree<T>::computeLevels(ConstructionDecision decision,
+                                     const std::vector<bool>& active,
+                                     std::vector<int>& levels) const {
+  int size = m_nodes.size();
+  levels.assign(size, 0);
+
+  std::vector<bool> kept(size);
+  if (decision == MAX) {
+    // sons before fathers
+    for (int i = size - 1; i >= 0; i--) {
+      Node* n = m_nodes[i];
+      if (active[i]) kept[i] = true;
+      if (kept[i] && n->father != n) kept[n->father->id] = true;
+    }
+  }
 
-  std::queue<Node*> fifoLeafs;
-  std::queue<Node*> fifo;
-  fifo.push(m_root);
+  for (int i = 0; i < size; i++) {
+    Node* n = m_nodes[i];
+    bool isRoot = (n->father == n);
+    bool k = kept[i];
+    nodeLevel(decision, n, active[i], isRoot ? 0 : levels[n->father->id],
+              isRoot || kept[n->father->id], levels[i], k);
+    kept[i] = k;
+  }
+}
 
-  while (!fifo.empty()) {
-    Node* currentNode = fifo.front();
-    fifo.pop();
+template <class T>
+void ComponentTree<T>::nodeLevel(ConstructionDecision decision, const Node* n,
+                                 bool active, int fatherLevel,
+                                 bool fatherKept, int& level, bool& kept) {
+  switch (decision) {
+    case MIN:
+      kept = active && fatherKept;
+      level = kept ? n->h : fatherLevel;
+      break;
+    case MAX:
+      level = kept ? n->h : fatherLevel;
+      break;
+    case DIRECT:
+      level = active ? n->h : fatherLevel;
+      break;
+    case SUBTRACTIVE:
+      level = fatherLevel;
+      if (active) level += (n->father == n) ? n->h : n->h - n->father->h;
+      break;
+  }
+}
 
-    currentNode->status = true;
-    if (currentNode->childs.size() != 0) {
-      for (Node::ContainerChilds::iterator it = currentNode->childs.begin();
-           it != currentNode->childs.end(); ++it)
-        fifo.push(*it);
-    } else
-      fifoLeafs.push(currentNode);
+template <class T>
+int ComponentTree<T>::ancestorsLevel(
+    ConstructionDecision decision, Node* n,
+    std::unordered_map<int, std::pair<int, bool> >& levels) {
+  // ancestors whose level is not known yet
+  std::vector<Node*> path;
+  for (Node* a = n; levels.find(a->id) == levels.end(); a = a->father) {
+    path.push_back(a);
+    if (a->father == a) break;
   }
-  while (!fifoLeafs.empty()) {
-    Node* tmp = fifoLeafs.front();
-    fifoLeafs.pop();
 
-    if (tmp->active == false && tmp->father->status == true) {
-      // we put father in the queue
-      fifoLeafs.push(tmp->father);
-      tmp->father->status = false;
-    } else if (tmp->active == true) {
-      // we construct image node at this level
-      std::vector<TOffset> subPixels = merge_pixels(tmp);
-      for (std::vector<TOffset>::iterator it = subPixels.begin();
-           it != subPixels.end(); ++it)
-        res(*it) = (T)tmp->h;
+  for (int i = path.size() - 1; i >= 0; i--) {
+    Node* a = path[i];
+    int fatherLevel = 0;
+    bool fatherKept = true;
+    if (a->father != a) {
+      const std::pair<int, bool>& father = levels[a->father->id];
+      fatherLevel = father.first;
+      fatherKept = father.second;
     }
+    std::pair<int, bool>& level = levels[a->id];
+    nodeLevel(decision, a, a->active, fatherLevel, fatherKept, level.first,
+              level.second);
   }
+  return levels[n->id].first;
 }
 
 template <class T>
-void ComponentTree<T>::constructImageDirect(Image<T>& res) {
-  res.fill(T(0));
-
-  std::queue<Node*> fifo;
-  fifo.push(m_root);
-  while (!fifo.empty()) {
-    Node* tmp = fifo.front();
-    fifo.pop();
+void ComponentTree<T>::constructImageLevels(
+    T* res, const std::vector<int>& levels) const {
+  if (m_nodes.empty()) {
+    std::fill_n(res, m_img.getBufSize(), T(0));
+    return;
+  }
 
-    if (tmp->active == true) {
-      for (std::vector<TOffset>::iterator it = tmp->pixels.begin();
-           it != tmp->pixels.end(); ++it)
-        res(*it) = (T)tmp->h;
-
-      for (std::vector<Node*>::iterator it = tmp->childs.begin();
-           it != tmp->childs.end(); ++it) {
-        // return all pixels of all consecutive false subnodes
-        // stop when an active node is found
-        if ((*it)->active == false) {
-          std::vector<TOffset> subPixels = merge_pixelsFalseNodes(*it);
-          for (std::vector<TOffset>::iterator it2 = subPixels.begin();
-               it2 != subPixels.end(); ++it2)
-            res(*it2) = (T)tmp->h;
-        }
+  std::vector<T> table(levels.size());
+  for (int i = 0; i < table.size(); i++) table[i] = (T)levels[i];
 
-        fifo.push(*it);
-      }
-    } else {
-      for (std::vector<Node*>::iterator it = tmp->childs.begin();
-           it != tmp->childs.end(); ++it) {
-        fifo.push(*it);
-      }
-    }
-  }
+  // sequential scan of the node ids
+  const int32_t* ids = &m_nodeIds[0];
+  const T* levelOf = &table[0];
+  renderImage(res, [ids, levelOf](TOffset p) { return levelOf[ids[p]]; });
 }
 
 template <class T>
-void ComponentTree<T>::constructImageDirectExpe(Image<T>& res) {
-  res.fill(0);
+Image<T> ComponentTree<T>::constructImage(const ImageRegion& roi,
+                                          ConstructionDecision decision) {
+  Image<T> res(roi.getSize());
+  constructImage(res.getData(), roi, decision);
+  return res;
+}
 
-  std::queue<Node*> fifo;
-  std::queue<Node*> fifo2;
+template <class T>
+void ComponentTree<T>::constructImage(Image<T>& res, const ImageRegion& roi,
+                                      ConstructionDecision decision) {
+  constructImage(outputBuffer(res, roi.getSize()), roi, decision);
+}
 
-  fifo.push(m_root);
+template <class T>
+void ComponentTree<T>::constructImage(T* res, const ImageRegion& roi,
+                                      ConstructionDecision decision) {
+  if (m_root == 0) {
+    std::fill_n(res, roi.getBufSize(), T(0));
+    return;
+  }
 
-  while (!fifo.empty()) {
-    Node* tmp = fifo.front();
-    fifo.pop();
+  if (decision == MAX) {
+    // kept nodes depend on their descendants: levels of all the nodes
+    std::vector<int> levels;
+    computeLevels(MAX, levels);
+    renderRegion(res, roi,
+                 [&](TOffset offset) { return (T)levels[m_nodeIds[offset]]; });
+    return;
+  }
 
-    if (tmp->active == true) {
-      fifo2.push(tmp);
+  // levels of the nodes met in roi and of their ancestors only
+  std::unordered_map<int, std::pair<int, bool> > levels;
+  int lastId = -1;
+  T last = 0;
+  renderRegion(res, roi, [&](TOffset offset) {
+    int id = m_nodeIds[offset];
+    if (id != lastId) {
+      last = (T)ancestorsLevel(decision, m_nodes[id], levels);
+      lastId = id;
     }
+    return last;
+  });
+}
 
-    else
-      for (std::vector<Node*>::iterator it = tmp->childs.begin();
-           it != tmp->childs.end(); ++it) {
-        fifo.push(*it);
-      }
+template <class T>
+template <class TVal, class F>
+void ComponentTree<T>::renderImage(TVal* out, const F& value) const {
+  TOffset rowSize = m_img.getSizeX();
+  renderBands([out, rowSize, &value](std::size_t row) {
+    TOffset end = (row + 1) * rowSize;
+    for (TOffset p = row * rowSize; p < end; p++) out[p] = value(p);
+  });
+}
+
+template <class T>
+template <class TVal>
+void ComponentTree<T>::renderInterleaved(
+    TVal* res, const std::vector<std::vector<TVal> >& tables) {
+  int channels = tables.size();
+  if (m_root == 0) {
+    std::fill_n(res, m_img.getBufSize() * channels, TVal(0));
+    return;
   }
 
-  while (!fifo2.empty()) {
-    Node* tmp = fifo2.front();
-    fifo2.pop();
+  // values of a node stored together, copied at once for each pixel
+  int size = m_nodes.size();
+  std::vector<TVal> values((std::size_t)size * channels);
+  for (int c = 0; c < channels; c++)
+    for (int i = 0; i < size; i++)
+      values[(std::size_t)i * channels + c] = tables[c][i];
+
+  TOffset rowSize = m_img.getSizeX();
+  const int32_t* ids = &m_nodeIds[0];
+  const TVal* valueOf = values.empty() ? 0 : &values[0];
+  renderBands([&](std::size_t row) {
+    TOffset end = (row + 1) * rowSize;
+    for (TOffset p = row * rowSize; p < end; p++) {
+      const TVal* v = valueOf + (TOffset)ids[p] * channels;
+      std::copy(v, v + channels, res + p * channels);
+    }
+  });
+}
 
-    for (std::vector<TOffset>::iterator it = tmp->pixels.begin();
-         it != tmp->pixels.end(); ++it)
-      res(*it) = (T)tmp->h;
+template <class T>
+template <class F>
+void ComponentTree<T>::renderBands(const F& renderRow) const {
+  TOffset rowSize = m_img.getSizeX();
+  TOffset rows = rowSize > 0 ? m_img.getBufSize() / rowSize : 0;
+
+  if (m_scheduler != 0) {
+    TOffset grain = std::max((TOffset)1, RENDER_GRAIN / rowSize);
+    m_scheduler->parallelFor(0, rows, grain, renderRow);
+  } else
+    for (TOffset row = 0; row < rows; row++) renderRow(row);
+}
 
-    for (std::vector<Node*>::iterator it = tmp->childs.begin();
-         it != tmp->childs.end(); ++it) {
-      if ((*it)->active == false) {
-        (*it)->h = tmp->h;
-      }
+template <class T>
+template <class TVal, class F>
+void ComponentTree<T>::renderRegion(TVal* out, const ImageRegion& roi,
+                                    const F& value) {
+  // part of roi inside the image
+  TCoord origin[3] = {roi.x, roi.y, roi.z};
+  TCoord first[3], last[3];
+  bool clipped = false;
+  for (int d = 0; d < 3; d++) {
+    first[d] = std::max((TCoord)0, origin[d]);
+    last[d] = std::min((TCoord)m_img.getSize()[d], origin[d] + roi.size[d]);
+    if (first[d] != origin[d] || last[d] != origin[d] + roi.size[d])
+      clipped = true;
+  }
+  if (clipped) std::fill_n(out, roi.getBufSize(), TVal(0));
+
+  for (TCoord z = first[2]; z < last[2]; z++)
+    for (TCoord y = first[1]; y < last[1]; y++) {
+      TOffset src = m_img.getOffset(first[0], y, z);
+      TOffset dst = (first[0] - origin[0]) +
+                    roi.size[0] * ((y - origin[1]) +
+                                   roi.size[1] * (z - origin[2]));
+      for (TCoord x = first[0]; x < last[0]; x++) out[dst++] = value(src++);
+    }
+}
 
-      fifo2.push(*it);
+template <class T>
+template <class TVal, class Select>
+void ComponentTree<T>::renderRegionAttribute(TVal* res,
+                                             const ImageRegion& roi,
+                                             Attribute value_attribute,
+                                             const Select& select) {
+  std::unordered_map<int, TVal> values;
+  int lastId = -1;
+  TVal last = 0;
+  renderRegion(res, roi, [&](TOffset offset) {
+    int id = m_nodeIds[offset];
+    if (id != lastId) {
+      typename std::unordered_map<int, TVal>::iterator it = values.find(id);
+      if (it == values.end())
+        it = values
+                 .insert(std::make_pair(
+                     id, attributeValue<TVal>(select(m_nodes[id]),
+                                              value_attribute)))
+                 .first;
+      last = it->second;
+      lastId = id;
     }
-  }
+    return last;
+  });
 }
 
 template <class T>
-Image<T> ComponentTree<T>::constructImage(ConstructionDecision decision) {
-  Image<T> res(m_img.getSize());
+template <class TVal>
+TVal* ComponentTree<T>::outputBuffer(Image<TVal>& res, const TSize* size) {
+  const TSize* resSize = res.getSize();
+  if (resSize[0] != size[0] || resSize[1] != size[1] || resSize[2] != size[2])
+    res.setSize(size);
+  return res.getData();
+}
 
-  if (m_root != 0) {
-    switch (decision) {
-      case MIN:
-        constructImageMin(res);
-        break;
-      case MAX:
-        constructImageMax(res);
-        break;
-      case DIRECT:
-        constructImageDirectExpe(res);
-        break;
-    }
-  }
+template <class T>
+void ComponentTree<T>::constructImage(Image<T>& res,
+                                      ConstructionDecision decision) {
+  constructImage(outputBuffer(res, m_img.getSize()), decision);
+}
 
-  else
-    res.fill(T(0));
+template <class T>
+void ComponentTree<T>::constructImage(T* res, ConstructionDecision decision) {
+  std::vector<int> levels;
+  computeLevels(decision, levels);
+  constructImageLevels(res, levels);
+}
+
+template <class T>
+void ComponentTree<T>::constructImageMin(Image<T>& res) {
+  constructImage(res, MIN);
+}
+
+template <class T>
+void ComponentTree<T>::constructImageMax(Image<T>& res) {
+  constructImage(res, MAX);
+}
+
+template <class T>
+void ComponentTree<T>::constructImageDirect(Image<T>& res) {
+  constructImage(res, DIRECT);
+}
+
+// Former implementation of DIRECT, which gave the level of their father to the
+// removed nodes (Node::h); same result without changing the tree
+template <class T>
+void ComponentTree<T>::constructImageDirectExpe(Image<T>& res) {
+  constructImage(res, DIRECT);
+}
 
+template <class T>
+Image<T> ComponentTree<T>::constructImage(ConstructionDecision decision) {
+  Image<T> res(m_img.getSize());
+  constructImage(res.getData(), decision);
   return res;
 }
 
 template <class T>
 template <class TVal>
-TVal ComponentTree<T>::getAttribute(Node* n,
-                                    ComponentTree::Attribute attribute_id) {
+inline TVal ComponentTree<T>::attributeValue(Node* n,
+                                      ComponentTree::Attribute attribute_id) {
   switch (attribute_id) {
     case H:
       return n->h;
@@ -418,190 +1056,288 @@ TVal ComponentTree<T>::getAttribute(Node* n,
       return n->complexity;
     case COMPACITY:
       return n->compacity;
+    case INERTIA:
+      return m_moments[n->id].inertia;
+    case ELONGATION:
+      return m_moments[n->id].elongation;
+    case ORIENTATION:
+      return m_moments[n->id].orientation;
+    case HU_1:
+    case HU_2:
+    case HU_3:
+    case HU_4:
+    case HU_5:
+    case HU_6:
+    case HU_7:
+      return m_moments[n->id].hu[attribute_id - HU_1];
+    case MEDIAN:
+      return m_histograms[n->id].median;
+    case ENTROPY:
+      return m_histograms[n->id].entropy;
+    case OTSU_HISTOGRAM:
+      return m_histograms[n->id].otsu;
+    case EXTINCTION:
+      return m_extinction[n->id];
+    case DYNAMICS:
+      return m_dynamics[n->id];
+    case INSCRIBED_RADIUS:
+      return m_inscribedRadius[n->id];
   }
   return 0;
 }
 
+// Selection rules: starting from the node of a pixel, the node of its
+// branch with the lowest (MIN) or highest (MAX) selection attribute, the
+// optional limit attribute bounding the part of the branch which is scanned
+
+template <class T>
+template <class TSel>
+Node* ComponentTree<T>::selectMin(Node* n, Attribute selection_attribute) {
+  // noeud selectionné
+  Node* n_s = n;
+  TSel attr = attributeValue<TSel>(n, selection_attribute);
+  // minimum, dans la branche parent
+  TSel attr_father;
+  // parcours de l'arbre
+  while (n->father != m_root) {
+    n = n->father;
+    attr_father = attributeValue<TSel>(n, selection_attribute);
+
+    if (attr_father < attr && attr_father > 0) {
+      n_s = n;
+      attr = attr_father;
+    }
+  }
+  return n_s;
+}
+
+template <class T>
+template <class TSel>
+Node* ComponentTree<T>::selectMax(Node* n, Attribute selection_attribute) {
+  // noeud selectionné
+  Node* n_s = n;
+  TSel attr = attributeValue<TSel>(n, selection_attribute);
+  // maximum dans la branche parent
+  TSel attr_father;
+  // parcours de l'arbre
+  while (n->father != m_root) {
+    n = n->father;
+    attr_father = attributeValue<TSel>(n, selection_attribute);
+
+    if (attr_father > attr &&
+        attr_father < std::numeric_limits<TSel>::max()) {
+      n_s = n;
+      attr = attr_father;
+    }
+  }
+  return n_s;
+}
+
+template <class T>
+template <class TSel, class TLimit>
+Node* ComponentTree<T>::selectMin(Node* n,
+                                  ComponentTree::Attribute selection_attribute,
+                                  Attribute limit_attribute, TLimit limit_min,
+                                  TLimit limit_max) {
+  n = selectDirect(n, limit_attribute, limit_min);
+  // noeud selectionné
+  Node* n_s = n;
+  TSel attr = attributeValue<TSel>(n, selection_attribute);
+  // minimum, dans la branche parent
+  TSel attr_father;
+  // parcours de l'arbre et limit max
+  while (n->father != m_root &&
+         attributeValue<TLimit>(n->father, limit_attribute) < limit_max) {
+    n = n->father;
+    attr_father = attributeValue<TSel>(n, selection_attribute);
+
+    if (attr_father < attr && attr_father > 0) {
+      n_s = n;
+      attr = attr_father;
+    }
+  }
+  return n_s;
+}
+
+template <class T>
+template <class TSel, class TLimit>
+Node* ComponentTree<T>::selectMax(Node* n,
+                                  ComponentTree::Attribute selection_attribute,
+                                  Attribute limit_attribute, TLimit limit_min,
+                                  TLimit limit_max) {
+  n = selectDirect(n, limit_attribute, limit_min);
+  // noeud selectionné
+  Node* n_s = n;
+  TSel attr = attributeValue<TSel>(n, selection_attribute);
+  // maximum dans la branche parent
+  TSel attr_father;
+  // parcours de l'arbre et limit max
+  while (n->father != m_root &&
+         attributeValue<TLimit>(n->father, limit_attribute) < limit_max) {
+    n = n->father;
+    attr_father = attributeValue<TSel>(n, selection_attribute);
+
+    if (attr_father > attr &&
+        attr_father < std::numeric_limits<TSel>::max()) {
+      n_s = n;
+      attr = attr_father;
+    }
+  }
+  return n_s;
+}
+
+template <class T>
+template <class TLimit>
+Node* ComponentTree<T>::selectDirect(Node* n, Attribute limit_attribute,
+                                     TLimit limit_min) {
+  // limit min
+  while (n->father != m_root &&
+         attributeValue<TLimit>(n->father, limit_attribute) < limit_min) {
+    n = n->father;
+  }
+  return n;
+}
+
+// Same selection for all the nodes in one pass over m_nodes (fathers before
+// sons), instead of a branch walk per pixel:
+// - start: node from which the branch of a node is scanned (limit min)
+// - best: node of the scanned branch of a node with the lowest positive (MIN)
+//   or highest non maximal (MAX) value, the deepest one for ties, -1 if none
+// The selected node of a node is best(start), unless the value of start
+// itself cannot be replaced.
+template <class T>
+template <class TSel, class TLimit>
+void ComponentTree<T>::selectNodes(ConstructionDecision selection_rule,
+                                   Attribute selection_attribute, bool limited,
+                                   Attribute limit_attribute, TLimit limit_min,
+                                   TLimit limit_max,
+                                   std::vector<int>& selected) {
+  std::vector<TSel> value;
+  if (selection_rule != DIRECT) attributeValues(selection_attribute, value);
+  std::vector<TLimit> limit;
+  if (limited) attributeValues(limit_attribute, limit);
+  selectNodes(selection_rule, value.empty() ? 0 : &value[0],
+              limited ? &limit[0] : 0, limit_min, limit_max, selected);
+}
+
+template <class T>
+template <class TSel, class TLimit>
+void ComponentTree<T>::selectNodes(ConstructionDecision selection_rule,
+                                   const TSel* value, const TLimit* limit,
+                                   TLimit limit_min, TLimit limit_max,
+                                   std::vector<int>& selected) {
+  int size = m_nodes.size();
+  bool isMin = (selection_rule == MIN);
+  bool limited = (limit != 0);
+
+  std::vector<int> start(size), best(size);
+  std::vector<bool> candidate(size);
+  for (int i = 0; i < size; i++) {
+    Node* father = m_nodes[i]->father;
+    bool hasFather = (father != m_root);
+    TLimit fatherLimit = 0;
+    if (limited && hasFather) fatherLimit = limit[father->id];
+
+    start[i] = (limited && hasFather && fatherLimit < limit_min)
+                   ? start[father->id]
+                   : i;
+
+    if (selection_rule == DIRECT) continue;
+    candidate[i] = isMin ? value[i] > 0
+                         : value[i] < std::numeric_limits<TSel>::max();
+    int fatherBest = -1;
+    if (hasFather && (!limited || fatherLimit < limit_max))
+      fatherBest = best[father->id];
+    bool better = fatherBest == -1 || (isMin ? value[i] <= value[fatherBest]
+                                             : value[i] >= value[fatherBest]);
+    best[i] = (candidate[i] && better) ? i : fatherBest;
+  }
+
+  selected.resize(size);
+  for (int i = 0; i < size; i++) {
+    int s = start[i];
+    selected[i] = (selection_rule != DIRECT && candidate[s]) ? best[s] : s;
+  }
+}
+
+template <class T>
+template <class TVal>
+void ComponentTree<T>::renderSelected(TVal* res, Attribute value_attribute,
+                                      const std::vector<int>& selected) {
+  std::vector<TVal> column;
+  attributeValues(value_attribute, column);
+  std::vector<TVal> values(m_nodes.size());
+  for (int i = 0; i < m_nodes.size(); i++) values[i] = column[selected[i]];
+
+  const int32_t* ids = &m_nodeIds[0];
+  const TVal* valueOf = &values[0];
+  renderImage(res, [ids, valueOf](TOffset p) { return valueOf[ids[p]]; });
+}
+
 template <class T>
 template <class TVal, class TSel>
 void ComponentTree<T>::constructImageAttributeMin(
-    Image<TVal>& res, ComponentTree::Attribute value_attribute,
+    TVal* res, ComponentTree::Attribute value_attribute,
     ComponentTree::Attribute selection_attribute) {
-  res.fill(TVal(0));
-
-  std::vector<Node*> nodes = indexedNodes();
-  for (TSize i = 0; i < res.getSizeX(); i++)
-    for (TSize j = 0; j < res.getSizeY(); j++)
-      for (TSize k = 0; k < res.getSizeZ(); k++) {
-        Node* n = indexedCoordToNode(i, j, k, nodes);
-        // noeud selectionné
-        Node* n_s = n;
-        TSel attr = getAttribute<TSel>(n, selection_attribute);
-        // minimum, dans la branche parent
-        TSel attr_father;
-        // parcours de l'arbre
-        while (n->father != m_root) {
-          n = n->father;
-          attr_father = getAttribute<TSel>(n, selection_attribute);
-
-          if (attr_father < attr && attr_father > 0) {
-            n_s = n;
-            attr = attr_father;
-          }
-        }
-
-        res(i, j, k) = getAttribute<TVal>(n_s, value_attribute);
-      }
+  std::vector<int> selected;
+  selectNodes<TSel, TSel>(MIN, selection_attribute, false, selection_attribute,
+                          0, 0, selected);
+  renderSelected(res, value_attribute, selected);
 }
 
 template <class T>
 template <class TVal, class TSel>
 void ComponentTree<T>::constructImageAttributeMax(
-    Image<TVal>& res, ComponentTree::Attribute value_attribute,
+    TVal* res, ComponentTree::Attribute value_attribute,
     ComponentTree::Attribute selection_attribute) {
-  res.fill(TVal(0));
-
-  std::vector<Node*> nodes = indexedNodes();
-  for (TSize i = 0; i < res.getSizeX(); i++)
-    for (TSize j = 0; j < res.getSizeY(); j++)
-      for (TSize k = 0; k < res.getSizeZ(); k++) {
-        Node* n = indexedCoordToNode(i, j, k, nodes);
-        // noeud selectionné
-        Node* n_s = n;
-        TSel attr = getAttribute<TSel>(n, selection_attribute);
-        // maximum dans la branche parent
-        TSel attr_father;
-        // parcours de l'arbre
-        while (n->father != m_root) {
-          n = n->father;
-          attr_father = getAttribute<TSel>(n, selection_attribute);
-
-          if (attr_father > attr &&
-              attr_father < std::numeric_limits<TSel>::max()) {
-            n_s = n;
-            attr = attr_father;
-          }
-        }
-
-        res(i, j, k) = getAttribute<TVal>(n_s, value_attribute);
-      }
+  std::vector<int> selected;
+  selectNodes<TSel, TSel>(MAX, selection_attribute, false, selection_attribute,
+                          0, 0, selected);
+  renderSelected(res, value_attribute, selected);
 }
 
 template <class T>
 template <class TVal>
 void ComponentTree<T>::constructImageAttributeDirect(
-    Image<TVal>& res, ComponentTree::Attribute value_attribute) {
-  res.fill(TVal(0));
-
-  std::vector<Node*> nodes = indexedNodes();
-  for (TSize i = 0; i < res.getSizeX(); i++)
-    for (TSize j = 0; j < res.getSizeY(); j++)
-      for (TSize k = 0; k < res.getSizeZ(); k++) {
-        Node* n = indexedCoordToNode(i, j, k, nodes);
-        TVal attr = getAttribute<TVal>(n, value_attribute);
-        res(i, j, k) = attr;
-      }
+    TVal* res, ComponentTree::Attribute value_attribute) {
+  std::vector<int> selected(m_nodes.size());
+  for (int i = 0; i < selected.size(); i++) selected[i] = i;
+  renderSelected(res, value_attribute, selected);
 }
 
 template <class T>
 template <class TVal, class TSel, class TLimit>
 void ComponentTree<T>::constructImageAttributeMin(
-    Image<TVal>& res, ComponentTree::Attribute value_attribute,
+    TVal* res, ComponentTree::Attribute value_attribute,
     ComponentTree::Attribute selection_attribute, Attribute limit_attribute,
     TLimit limit_min, TLimit limit_max) {
-  res.fill(TVal(0));
-
-  std::vector<Node*> nodes = indexedNodes();
-  for (TSize i = 0; i < res.getSizeX(); i++)
-    for (TSize j = 0; j < res.getSizeY(); j++)
-      for (TSize k = 0; k < res.getSizeZ(); k++) {
-        Node* n = indexedCoordToNode(i, j, k, nodes);
-        // limit min
-        while (n->father != m_root &&
-               getAttribute<TLimit>(n->father, limit_attribute) < limit_min) {
-          n = n->father;
-        }
-        // noeud selectionné
-        Node* n_s = n;
-        TSel attr = getAttribute<TSel>(n, selection_attribute);
-        // minimum, dans la branche parent
-        TSel attr_father;
-        // parcours de l'arbre et limit max
-        while (n->father != m_root &&
-               getAttribute<TLimit>(n->father, limit_attribute) < limit_max) {
-          n = n->father;
-          attr_father = getAttribute<TSel>(n, selection_attribute);
-
-          if (attr_father < attr && attr_father > 0) {
-            n_s = n;
-            attr = attr_father;
-          }
-        }
-
-        res(i, j, k) = getAttribute<TVal>(n_s, value_attribute);
-      }
+  std::vector<int> selected;
+  selectNodes<TSel, TLimit>(MIN, selection_attribute, true, limit_attribute,
+                            limit_min, limit_max, selected);
+  renderSelected(res, value_attribute, selected);
 }
 
 template <class T>
 template <class TVal, class TSel, class TLimit>
 void ComponentTree<T>::constructImageAttributeMax(
-    Image<TVal>& res, ComponentTree::Attribute value_attribute,
+    TVal* res, ComponentTree::Attribute value_attribute,
     ComponentTree::Attribute selection_attribute, Attribute limit_attribute,
     TLimit limit_min, TLimit limit_max) {
-  res.fill(TVal(0));
-
-  std::vector<Node*> nodes = indexedNodes();
-  for (TSize i = 0; i < res.getSizeX(); i++)
-    for (TSize j = 0; j < res.getSizeY(); j++)
-      for (TSize k = 0; k < res.getSizeZ(); k++) {
-        Node* n = indexedCoordToNode(i, j, k, nodes);
-        // limit min
-        while (n->father != m_root &&
-               getAttribute<TLimit>(n->father, limit_attribute) < limit_min) {
-          n = n->father;
-        }
-        // noeud selectionné
-        Node* n_s = n;
-        TSel attr = getAttribute<TSel>(n, selection_attribute);
-        // maximum dans la branche parent
-        TSel attr_father;
-        // parcours de l'arbre et limit max
-        while (n->father != m_root &&
-               getAttribute<TLimit>(n->father, limit_attribute) < limit_max) {
-          n = n->father;
-          attr_father = getAttribute<TSel>(n, selection_attribute);
-
-          if (attr_father > attr &&
-              attr_father < std::numeric_limits<TSel>::max()) {
-            n_s = n;
-            attr = attr_father;
-          }
-        }
-
-        res(i, j, k) = getAttribute<TVal>(n_s, value_attribute);
-      }
+  std::vector<int> selected;
+  selectNodes<TSel, TLimit>(MAX, selection_attribute, true, limit_attribute,
+                            limit_min, limit_max, selected);
+  renderSelected(res, value_attribute, selected);
 }
 
 template <class T>
 template <class TVal, class TLimit>
 void ComponentTree<T>::constructImageAttributeDirect(
-    Image<TVal>& res, ComponentTree::Attribute value_attribute,
+    TVal* res, ComponentTree::Attribute value_attribute,
     Attribute limit_attribute, TLimit limit_min, TLimit limit_max) {
-  res.fill(TVal(0));
-
-  std::vector<Node*> nodes = indexedNodes();
-  for (TSize i = 0; i < res.getSizeX(); i++)
-    for (TSize j = 0; j < res.getSizeY(); j++)
-      for (TSize k = 0; k < res.getSizeZ(); k++) {
-        Node* n = indexedCoordToNode(i, j, k, nodes);
-        // limit min
-        while (n->father != m_root &&
-               getAttribute<TLimit>(n->father, limit_attribute) < limit_min) {
-          n = n->father;
-        }
-        TVal attr = getAttribute<TVal>(n, value_attribute);
-        res(i, j, k) = attr;
-      }
+  std::vector<int> selected;
+  selectNodes<TLimit, TLimit>(DIRECT, limit_attribute, true, limit_attribute,
+                              limit_min, limit_max, selected);
+  renderSelected(res, value_attribute, selected);
 }
 
 template <class T>
@@ -611,6 +1347,30 @@ Image<TVal> ComponentTree<T>::constructImageAttribute(
     ComponentTree::Attribute selection_attribute,
     ComponentTree::ConstructionDecision selection_rule) {
   Image<TVal> res(m_img.getSize());
+  constructImageAttribute<TVal, TSel>(res.getData(), value_attribute,
+                                      selection_attribute, selection_rule);
+  return res;
+}
+
+template <class T>
+template <class TVal, class TSel>
+void ComponentTree<T>::constructImageAttribute(
+    Image<TVal>& res, ComponentTree::Attribute value_attribute,
+    ComponentTree::Attribute selection_attribute,
+    ComponentTree::ConstructionDecision selection_rule) {
+  constructImageAttribute<TVal, TSel>(outputBuffer(res, m_img.getSize()),
+                                      value_attribute, selection_attribute,
+                                      selection_rule);
+}
+
+template <class T>
+template <class TVal, class TSel>
+void ComponentTree<T>::constructImageAttribute(
+    TVal* res, ComponentTree::Attribute value_attribute,
+    ComponentTree::Attribute selection_attribute,
+    ComponentTree::ConstructionDecision selection_rule) {
+  computeAttributes(attributeDependencies(value_attribute) |
+                    attributeDependencies(selection_attribute));
 
   if (m_root != 0) {
     switch (selection_rule) {
@@ -625,11 +1385,13 @@ Image<TVal> ComponentTree<T>::constructImageAttribute(
       case DIRECT:
         constructImageAttributeDirect<TVal>(res, value_attribute);
         break;
+      // not a selection rule
+      case SUBTRACTIVE:
+        std::fill_n(res, m_img.getBufSize(), TVal(0));
+        break;
     }
   } else
-    res.fill(TVal(0));
-
-  return res;
+    std::fill_n(res, m_img.getBufSize(), TVal(0));
 }
 
 template <class T>
@@ -640,6 +1402,34 @@ Image<TVal> ComponentTree<T>::constructImageAttribute(
     ComponentTree::ConstructionDecision selection_rule,
     Attribute limit_attribute, TLimit limit_min, TLimit limit_max) {
   Image<TVal> res(m_img.getSize());
+  constructImageAttribute<TVal, TSel, TLimit>(
+      res.getData(), value_attribute, selection_attribute, selection_rule,
+      limit_attribute, limit_min, limit_max);
+  return res;
+}
+
+template <class T>
+template <class TVal, class TSel, class TLimit>
+void ComponentTree<T>::constructImageAttribute(
+    Image<TVal>& res, ComponentTree::Attribute value_attribute,
+    ComponentTree::Attribute selection_attribute,
+    ComponentTree::ConstructionDecision selection_rule,
+    Attribute limit_attribute, TLimit limit_min, TLimit limit_max) {
+  constructImageAttribute<TVal, TSel, TLimit>(
+      outputBuffer(res, m_img.getSize()), value_attribute, selection_attribute,
+      selection_rule, limit_attribute, limit_min, limit_max);
+}
+
+template <class T>
+template <class TVal, class TSel, class TLimit>
+void ComponentTree<T>::constructImageAttribute(
+    TVal* res, ComponentTree::Attribute value_attribute,
+    ComponentTree::Attribute selection_attribute,
+    ComponentTree::ConstructionDecision selection_rule,
+    Attribute limit_attribute, TLimit limit_min, TLimit limit_max) {
+  computeAttributes(attributeDependencies(value_attribute) |
+                    attributeDependencies(selection_attribute) |
+                    attributeDependencies(limit_attribute));
 
   if (m_root != 0) {
     switch (selection_rule) {
@@ -657,13 +1447,466 @@ Image<TVal> ComponentTree<T>::constructImageAttribute(
         constructImageAttributeDirect<TVal, TLimit>(
             res, value_attribute, limit_attribute, limit_min, limit_max);
         break;
+      // not a selection rule
+      case SUBTRACTIVE:
+        std::fill_n(res, m_img.getBufSize(), TVal(0));
+        break;
     }
   } else
-    res.fill(TVal(0));
+    std::fill_n(res, m_img.getBufSize(), TVal(0));
+}
+
+template <class T>
+template <class TVal, class TSel>
+Image<TVal> ComponentTree<T>::constructImageAttribute(
+    const ImageRegion& roi, ComponentTree::Attribute value_attribute,
+    ComponentTree::Attribute selection_attribute,
+    ComponentTree::ConstructionDecision selection_rule) {
+  Image<TVal> res(roi.getSize());
+  constructImageAttribute<TVal, TSel>(res.getData(), roi, value_attribute,
+                                      selection_attribute, selection_rule);
+  return res;
+}
+
+template <class T>
+template <class TVal, class TSel>
+void ComponentTree<T>::constructImageAttribute(
+    Image<TVal>& res, const ImageRegion& roi,
+    ComponentTree::Attribute value_attribute,
+    ComponentTree::Attribute selection_attribute,
+    ComponentTree::ConstructionDecision selection_rule) {
+  constructImageAttribute<TVal, TSel>(outputBuffer(res, roi.getSize()), roi,
+                                      value_attribute, selection_attribute,
+                                      selection_rule);
+}
+
+template <class T>
+template <class TVal, class TSel>
+void ComponentTree<T>::constructImageAttribute(
+    TVal* res, const ImageRegion& roi,
+    ComponentTree::Attribute value_attribute,
+    ComponentTree::Attribute selection_attribute,
+    ComponentTree::ConstructionDecision selection_rule) {
+  computeAttributes(attributeDependencies(value_attribute) |
+                    attributeDependencies(selection_attribute));
+
+  if (m_root != 0) {
+    switch (selection_rule) {
+      case MIN:
+        renderRegionAttribute(res, roi, value_attribute, [&](Node* n) {
+          return selectMin<TSel>(n, selection_attribute);
+        });
+        break;
+      case MAX:
+        renderRegionAttribute(res, roi, value_attribute, [&](Node* n) {
+          return selectMax<TSel>(n, selection_attribute);
+        });
+        break;
+      case DIRECT:
+        renderRegionAttribute(res, roi, value_attribute,
+                              [](Node* n) { return n; });
+        break;
+      // not a selection rule
+      case SUBTRACTIVE:
+        std::fill_n(res, roi.getBufSize(), TVal(0));
+        break;
+    }
+  } else
+    std::fill_n(res, roi.getBufSize(), TVal(0));
+}
+
+template <class T>
+template <class TVal, class TSel, class TLimit>
+Image<TVal> ComponentTree<T>::constructImageAttribute(
+    const ImageRegion& roi, ComponentTree::Attribute value_attribute,
+    ComponentTree::Attribute selection_attribute,
+    ComponentTree::ConstructionDecision selection_rule,
+    Attribute limit_attribute, TLimit limit_min, TLimit limit_max) {
+  Image<TVal> res(roi.getSize());
+  constructImageAttribute<TVal, TSel, TLimit>(
+      res.getData(), roi, value_attribute, selection_attribute, selection_rule,
+      limit_attribute, limit_min, limit_max);
+  return res;
+}
+
+template <class T>
+template <class TVal, class TSel, class TLimit>
+void ComponentTree<T>::constructImageAttribute(
+    Image<TVal>& res, const ImageRegion& roi,
+    ComponentTree::Attribute value_attribute,
+    ComponentTree::Attribute selection_attribute,
+    ComponentTree::ConstructionDecision selection_rule,
+    Attribute limit_attribute, TLimit limit_min, TLimit limit_max) {
+  constructImageAttribute<TVal, TSel, TLimit>(
+      outputBuffer(res, roi.getSize()), roi, value_attribute,
+      selection_attribute, selection_rule, limit_attribute, limit_min,
+      limit_max);
+}
+
+template <class T>
+template <class TVal, class TSel, class TLimit>
+void ComponentTree<T>::constructImageAttribute(
+    TVal* res, const ImageRegion& roi,
+    ComponentTree::Attribute value_attribute,
+    ComponentTree::Attribute selection_attribute,
+    ComponentTree::ConstructionDecision selection_rule,
+    Attribute limit_attribute, TLimit limit_min, TLimit limit_max) {
+  computeAttributes(attributeDependencies(value_attribute) |
+                    attributeDependencies(selection_attribute) |
+                    attributeDependencies(limit_attribute));
+
+  if (m_root != 0) {
+    switch (selection_rule) {
+      case MIN:
+        renderRegionAttribute(res, roi, value_attribute, [&](Node* n) {
+          return selectMin<TSel>(n, selection_attribute, limit_attribute,
+                                 limit_min, limit_max);
+        });
+        break;
+      case MAX:
+        renderRegionAttribute(res, roi, value_attribute, [&](Node* n) {
+          return selectMax<TSel>(n, selection_attribute, limit_attribute,
+                                 limit_min, limit_max);
+        });
+        break;
+      case DIRECT:
+        renderRegionAttribute(res, roi, value_attribute, [&](Node* n) {
+          return selectDirect(n, limit_attribute, limit_min);
+        });
+        break;
+      // not a selection rule
+      case SUBTRACTIVE:
+        std::fill_n(res, roi.getBufSize(), TVal(0));
+        break;
+    }
+  } else
+    std::fill_n(res, roi.getBufSize(), TVal(0));
+}
+
+template <class T>
+template <class TVal, class TSel, class TLimit>
+std::vector<Image<TVal> > ComponentTree<T>::constructImageAttributes(
+    const std::vector<AttributeImageSpec>& specs) {
+  std::vector<Image<TVal> > res;
+  constructImageAttributes<TVal, TSel, TLimit>(specs, res);
+  return res;
+}
+
+template <class T>
+template <class TVal, class TSel, class TLimit>
+void ComponentTree<T>::constructImageAttributes(
+    const std::vector<AttributeImageSpec>& specs,
+    std::vector<Image<TVal> >& res) {
+  res.resize(specs.size());
+  std::vector<TVal*> buffers(specs.size());
+  for (int i = 0; i < specs.size(); i++)
+    buffers[i] = outputBuffer(res[i], m_img.getSize());
+  constructImageAttributes<TVal, TSel, TLimit>(
+      specs, buffers.empty() ? 0 : &buffers[0]);
+}
+
+template <class T>
+template <class TVal, class TSel, class TLimit>
+void ComponentTree<T>::constructImageAttributes(
+    const std::vector<AttributeImageSpec>& specs, TVal* const* res) {
+  std::vector<std::vector<TVal> > tables;
+  attributeTables<TVal, TSel, TLimit>(specs, tables);
+  renderTables(res, tables);
+}
+
+template <class T>
+template <class TOut, class TSel, class TLimit, class TVal>
+std::vector<Image<TOut> > ComponentTree<T>::constructImageAttributes(
+    const std::vector<AttributeImageSpec>& specs,
+    const std::vector<ValueRange>& ranges) {
+  std::vector<Image<TOut> > res;
+  constructImageAttributes<TOut, TSel, TLimit, TVal>(specs, ranges, res);
+  return res;
+}
+
+template <class T>
+template <class TOut, class TSel, class TLimit, class TVal>
+void ComponentTree<T>::constructImageAttributes(
+    const std::vector<AttributeImageSpec>& specs,
+    const std::vector<ValueRange>& ranges, std::vector<Image<TOut> >& res) {
+  if (ranges.size() != specs.size()) {
+    res.clear();
+    return;
+  }
+  res.resize(specs.size());
+  std::vector<TOut*> buffers(specs.size());
+  for (int i = 0; i < specs.size(); i++)
+    buffers[i] = outputBuffer(res[i], m_img.getSize());
+  constructImageAttributes<TOut, TSel, TLimit, TVal>(
+      specs, ranges, buffers.empty() ? 0 : &buffers[0]);
+}
+
+template <class T>
+template <class TOut, class TSel, class TLimit, class TVal>
+void ComponentTree<T>::constructImageAttributes(
+    const std::vector<AttributeImageSpec>& specs,
+    const std::vector<ValueRange>& ranges, TOut* const* res) {
+  if (ranges.size() != specs.size()) return;
+  std::vector<std::vector<TVal> > tables;
+  attributeTables<TVal, TSel, TLimit>(specs, tables);
+  std::vector<std::vector<TOut> > quantized(tables.size());
+  for (int i = 0; i < tables.size(); i++)
+    quantizeValues(tables[i], ranges[i], quantized[i]);
+  renderTables(res, quantized);
+}
+
+template <class T>
+template <class TOut, class TSel, class TLimit, class TVal>
+void ComponentTree<T>::constructAttributeTensor(
+    const std::vector<AttributeImageSpec>& specs,
+    const std::vector<ValueRange>& ranges, TensorLayout layout, TOut* res) {
+  if (ranges.size() != specs.size()) return;
+  std::vector<std::vector<TVal> > tables;
+  attributeTables<TVal, TSel, TLimit>(specs, tables);
+  std::vector<std::vector<TOut> > quantized(tables.size());
+  for (int i = 0; i < tables.size(); i++)
+    quantizeValues(tables[i], ranges[i], quantized[i]);
+
+  if (layout == HWC)
+    renderInterleaved(res, quantized);
+  else {
+    std::vector<TOut*> planes(specs.size());
+    for (int i = 0; i < planes.size(); i++)
+      planes[i] = res + i * m_img.getBufSize();
+    renderTables(planes.empty() ? 0 : &planes[0], quantized);
+  }
+}
+
+template <class T>
+template <class TOut, class TSel, class TLimit, class TVal>
+int ComponentTree<T>::saveAttributeTensor(
+    const char* filename, const std::vector<AttributeImageSpec>& specs,
+    const std::vector<ValueRange>& ranges, TensorLayout layout) {
+  if (ranges.size() != specs.size()) return 0;
+  std::vector<TOut> tensor(m_img.getBufSize() * specs.size());
+  constructAttributeTensor<TOut, TSel, TLimit, TVal>(
+      specs, ranges, layout, tensor.empty() ? 0 : &tensor[0]);
+
+  std::vector<TSize> shape;
+  if (layout == CHW) shape.push_back(specs.size());
+  if (m_img.getSizeZ() > 1) shape.push_back(m_img.getSizeZ());
+  shape.push_back(m_img.getSizeY());
+  shape.push_back(m_img.getSizeX());
+  if (layout == HWC) shape.push_back(specs.size());
+  return saveNpy(filename, tensor.empty() ? 0 : &tensor[0], shape);
+}
+
+template <class T>
+template <class TVal, class TSel, class TLimit>
+void ComponentTree<T>::attributeTables(
+    const std::vector<AttributeImageSpec>& specs,
+    std::vector<std::vector<TVal> >& tables) {
+  int ca = 0;
+  for (int i = 0; i < specs.size(); i++) {
+    ca |= attributeDependencies(specs[i].value_attribute) |
+          attributeDependencies(specs[i].selection_attribute);
+    if (specs[i].limited)
+      ca |= attributeDependencies(specs[i].limit_attribute);
+  }
+  computeAttributes(ca);
+  tables.assign(specs.size(), std::vector<TVal>());
+  if (m_root == 0) return;
+
+  // columns and selections, computed once for all the specifications
+  std::map<Attribute, std::vector<TVal> > values;
+  std::map<Attribute, std::vector<TSel> > selections;
+  std::map<Attribute, std::vector<TLimit> > limits;
+  // (rule, selection attribute, limit attribute, limit min, limit max), -1
+  // for an attribute which is not read
+  typedef std::tuple<int, int, int, TLimit, TLimit> SelectionKey;
+  std::map<SelectionKey, std::vector<int> > selected;
+
+  // value of each node in each image
+  int size = m_nodes.size();
+  for (int i = 0; i < specs.size(); i++) {
+    const AttributeImageSpec& spec = specs[i];
+    ConstructionDecision rule = spec.selection_rule;
+    if (rule == SUBTRACTIVE) {
+      tables[i].assign(size, TVal(0));
+      continue;
+    }
+    if (values.find(spec.value_attribute) == values.end())
+      attributeValues(spec.value_attribute, values[spec.value_attribute]);
+    const std::vector<TVal>& value = values[spec.value_attribute];
+    if (rule == DIRECT && !spec.limited) {
+      tables[i] = value;
+      continue;
+    }
+
+    TLimit limit_min = spec.limited ? (TLimit)spec.limit_min : 0;
+    TLimit limit_max = spec.limited ? (TLimit)spec.limit_max : 0;
+    SelectionKey key(rule, rule == DIRECT ? -1 : spec.selection_attribute,
+                     spec.limited ? spec.limit_attribute : -1, limit_min,
+                     limit_max);
+    if (selected.find(key) == selected.end()) {
+      const TSel* sel = 0;
+      if (rule != DIRECT) {
+        std::vector<TSel>& column = selections[spec.selection_attribute];
+        if (column.empty()) attributeValues(spec.selection_attribute, column);
+        sel = &column[0];
+      }
+      const TLimit* limit = 0;
+      if (spec.limited) {
+        std::vector<TLimit>& column = limits[spec.limit_attribute];
+        if (column.empty()) attributeValues(spec.limit_attribute, column);
+        limit = &column[0];
+      }
+      selectNodes(rule, sel, limit, limit_min, limit_max, selected[key]);
+    }
+    const std::vector<int>& node = selected[key];
+    tables[i].resize(size);
+    for (int n = 0; n < size; n++) tables[i][n] = value[node[n]];
+  }
+}
+
+template <class T>
+template <class TVal>
+std::vector<Image<TVal> > ComponentTree<T>::constructSignature(
+    Attribute value_attribute, const std::vector<int>& thresholds) {
+  std::vector<Image<TVal> > res;
+  constructSignature(res, value_attribute, thresholds);
+  return res;
+}
+
+template <class T>
+template <class TVal>
+void ComponentTree<T>::constructSignature(
+    std::vector<Image<TVal> >& res, Attribute value_attribute,
+    const std::vector<int>& thresholds) {
+  res.resize(thresholds.size());
+  std::vector<TVal*> buffers(thresholds.size());
+  for (int i = 0; i < thresholds.size(); i++)
+    buffers[i] = outputBuffer(res[i], m_img.getSize());
+  constructSignature(buffers.empty() ? 0 : &buffers[0], value_attribute,
+                     thresholds);
+}
+
+template <class T>
+template <class TVal>
+void ComponentTree<T>::constructSignature(TVal* const* res,
+                                          Attribute value_attribute,
+                                          const std::vector<int>& thresholds) {
+  std::vector<std::vector<TVal> > tables;
+  signatureTables(value_attribute, thresholds, tables);
+  renderTables(res, tables);
+}
 
+template <class T>
+template <class TOut, class TVal>
+std::vector<Image<TOut> > ComponentTree<T>::constructSignature(
+    Attribute value_attribute, const std::vector<int>& thresholds,
+    const ValueRange& range) {
+  std::vector<Image<TOut> > res;
+  constructSignature<TOut, TVal>(res, value_attribute, thresholds, range);
   return res;
 }
 
+template <class T>
+template <class TOut, class TVal>
+void ComponentTree<T>::constructSignature(std::vector<Image<TOut> >& res,
+                                          Attribute value_attribute,
+                                          const std::vector<int>& thresholds,
+                                          const ValueRange& range) {
+  res.resize(thresholds.size());
+  std::vector<TOut*> buffers(thresholds.size());
+  for (int i = 0; i < thresholds.size(); i++)
+    buffers[i] = outputBuffer(res[i], m_img.getSize());
+  constructSignature<TOut, TVal>(buffers.empty() ? 0 : &buffers[0],
+                                 value_attribute, thresholds, range);
+}
+
+template <class T>
+template <class TOut, class TVal>
+void ComponentTree<T>::constructSignature(TOut* const* res,
+                                          Attribute value_attribute,
+                                          const std::vector<int>& thresholds,
+                                          const ValueRange& range) {
+  std::vector<std::vector<TVal> > tables;
+  signatureTables(value_attribute, thresholds, tables);
+  std::vector<std::vector<TOut> > quantized(tables.size());
+  for (int k = 0; k < tables.size(); k++)
+    quantizeValues(tables[k], range, quantized[k]);
+  renderTables(res, quantized);
+}
+
+template <class T>
+template <class TVal>
+void ComponentTree<T>::signatureTables(
+    Attribute value_attribute, const std::vector<int>& thresholds,
+    std::vector<std::vector<TVal> >& tables) {
+  computeAttributes(attributeDependencies(value_attribute));
+  tables.assign(thresholds.size(), std::vector<TVal>());
+  if (m_root == 0) return;
+
+  std::vector<TVal> value;
+  attributeValues(value_attribute, value);
+
+  // top-down: a node takes its own value in the planes of the thresholds
+  // above its level, and the value of its father in the others
+  int size = m_nodes.size();
+  int planes = thresholds.size();
+  for (int k = 0; k < planes; k++) tables[k].assign(size, TVal(0));
+  for (int i = 1; i < size; i++) {
+    int h = m_nodes[i]->h;
+    int father = m_nodes[i]->father->id;
+    for (int k = 0; k < planes; k++)
+      tables[k][i] = (h <= thresholds[k]) ? value[i] : tables[k][father];
+  }
+}
+
+template <class T>
+template <class TVal, class TOut>
+void ComponentTree<T>::quantizeValues(const std::vector<TVal>& values,
+                                      const ValueRange& range,
+                                      std::vector<TOut>& res) {
+  long double low = range.low, high = range.high;
+  if (high <= low) {
+    high = low + 1;
+    for (int i = 0; i < values.size(); i++)
+      high = std::max(high, (long double)values[i]);
+  }
+  long double scale = std::numeric_limits<TOut>::is_integer
+                          ? (long double)std::numeric_limits<TOut>::max()
+                          : 1;
+  long double width = high - low;
+
+  res.resize(values.size());
+  for (int i = 0; i < values.size(); i++) {
+    long double v = values[i];
+    // e.g. unset attributes: no integer conversion of NaN
+    if (std::isnan(v)) v = low;
+    v = std::min(std::max(v, low), high);
+    res[i] = (TOut)((v - low) / width * scale);
+  }
+}
+
+template <class T>
+template <class TVal>
+void ComponentTree<T>::renderTables(
+    TVal* const* res, const std::vector<std::vector<TVal> >& tables) {
+  if (m_root == 0) {
+    for (int i = 0; i < tables.size(); i++)
+      std::fill_n(res[i], m_img.getBufSize(), TVal(0));
+    return;
+  }
+
+  TOffset rowSize = m_img.getSizeX();
+  const int32_t* ids = &m_nodeIds[0];
+  renderBands([&](std::size_t row) {
+    TOffset begin = row * rowSize, end = begin + rowSize;
+    for (int i = 0; i < tables.size(); i++) {
+      TVal* out = res[i];
+      const TVal* valueOf = &tables[i][0];
+      for (TOffset p = begin; p < end; p++) out[p] = valueOf[ids[p]];
+    }
+  });
+}
+
 template <class T>
 void ComponentTree<T>::constructNode(Image<T>& res, Node* node) {
   std::queue<Node*> fifo;
@@ -704,21 +1947,7 @@ void ComponentTree<T>::constructNodeDirect(Image<T>& res, Node* node) {
 
 template <class T>
 void ComponentTree<T>::setFalse() {
-  if (m_root != 0) {
-    std::queue<Node*> fifo;
-    fifo.push(m_root);
-
-    while (!fifo.empty()) {
-      Node* tmp = fifo.front();
-      fifo.pop();
-
-      tmp->active = false;
-
-      for (std::vector<Node*>::iterator it = tmp->childs.begin();
-           it != tmp->childs.end(); ++it)
-        fifo.push(*it);
-    }
-  }
+  for (int i = 0; i < m_nodes.size(); i++) m_nodes[i]->active = false;
 }
 
 // Test whether the se is include in the component (pixels)
@@ -727,30 +1956,64 @@ template <class T>
 bool ComponentTree<T>::isInclude(FlatSE& se, Node::ContainerPixels& pixels) {
   // Case where the se is larger than the component:
   // obviously se does not fit in
-  if (se.getNbPoints() > pixels.size()) {
-    return false;
-  } else {
-    FlatSE::iterator itSe;
-    Node::ContainerPixels::iterator itPixels;
-    Node::ContainerPixels::iterator itPixels2;
-
-    for (itPixels = pixels.begin(); itPixels != pixels.end(); ++itPixels) {
-      bool isInclude = true;
-      for (itSe = se.begin(); itSe != se.end(); ++itSe) {
-        TOffset q = *itSe + *itPixels;
-        // Test if q belongs to pixels set
-        for (itPixels2 = pixels.begin(); itPixels2 != pixels.end(); ++itPixels2)
-          if (*itPixels2 == q) break;
-        if (itPixels2 == pixels.end()) {
-          isInclude = false;
-          break;
-        }
-      }
-      if (isInclude == true) return true;
-    }
+  if (se.getNbPoints() > pixels.size() || pixels.empty()) return false;
+
+  // extent of the se
+  Point<TCoord> seMin, seMax;
+  for (int i = 0; i < se.getNbPoints(); i++) {
+    Point<TCoord> s = se.getPoint(i);
+    seMin.x = std::min(seMin.x, s.x);
+    seMin.y = std::min(seMin.y, s.y);
+    seMin.z = std::min(seMin.z, s.z);
+    seMax.x = std::max(seMax.x, s.x);
+    seMax.y = std::max(seMax.y, s.y);
+    seMax.z = std::max(seMax.z, s.z);
+  }
 
-    return false;
+  // bitmap of the pixels in their bounding box
+  std::vector<Point<TCoord> > coords(pixels.size());
+  Point<TCoord> boxMin = m_img.getCoord(pixels[0]), boxMax = boxMin;
+  for (int i = 0; i < pixels.size(); i++) {
+    Point<TCoord> p = m_img.getCoord(pixels[i]);
+    boxMin.x = std::min(boxMin.x, p.x);
+    boxMin.y = std::min(boxMin.y, p.y);
+    boxMin.z = std::min(boxMin.z, p.z);
+    boxMax.x = std::max(boxMax.x, p.x);
+    boxMax.y = std::max(boxMax.y, p.y);
+    boxMax.z = std::max(boxMax.z, p.z);
+    coords[i] = p;
+  }
+  TSize bx = boxMax.x - boxMin.x + 1;
+  TSize bxy = bx * (boxMax.y - boxMin.y + 1);
+  std::vector<unsigned char> bitmap(bxy * (boxMax.z - boxMin.z + 1), 0);
+  for (int i = 0; i < coords.size(); i++)
+    bitmap[(coords[i].x - boxMin.x) + (coords[i].y - boxMin.y) * bx +
+           (coords[i].z - boxMin.z) * bxy] = 1;
+
+  for (int i = 0; i < coords.size(); i++) {
+    const Point<TCoord>& p = coords[i];
+    // the se centred on p must stay in the bounding box
+    if (p.x + seMin.x < boxMin.x || p.x + seMax.x > boxMax.x ||
+        p.y + seMin.y < boxMin.y || p.y + seMax.y > boxMax.y ||
+        p.z + seMin.z < boxMin.z || p.z + seMax.z > boxMax.z)
+      continue;
+    TOffset origin =
+        (p.x - boxMin.x) + (p.y - boxMin.y) * bx + (p.z - boxMin.z) * bxy;
+    int j = 0;
+    for (; j < se.getNbPoints(); j++) {
+      Point<TCoord> s = se.getPoint(j);
+      if (!bitmap[origin + s.x + s.y * bx + s.z * bxy]) break;
+    }
+    if (j == se.getNbPoints()) return true;
   }
+
+  return false;
+}
+
+template <class T>
+bool ComponentTree<T>::isInclude(FlatSE& se, Node* n) {
+  std::vector<TOffset> pixels = merge_pixels(n);
+  return isInclude(se, pixels);
 }
 
 // aggregate and return all pixels belonging to subtree
@@ -824,81 +2087,57 @@ void ComponentTree<T>::merge_pixels(Node* tree, std::vector<TOffset>& res) {
 
 template <class T>
 int ComponentTree<T>::restore() {
-  if (m_root != 0) {
-    std::queue<Node*> fifo;
-    fifo.push(m_root);
-
-    while (!fifo.empty()) {
-      Node* curNode = fifo.front();
-      fifo.pop();
-      curNode->active = true;
-      curNode->h = curNode->ori_h;
-      Node::ContainerChilds::iterator it;
-      for (it = curNode->childs.begin(); it != curNode->childs.end(); ++it)
-        fifo.push(*it);
-    }
+  for (int i = 0; i < m_nodes.size(); i++) {
+    m_nodes[i]->active = true;
+    m_nodes[i]->h = m_nodes[i]->ori_h;
   }
+  return 0;
 }
 
 template <class T>
 int ComponentTree<T>::areaFiltering(int64_t tMin, int64_t tMax) {
-  if (m_root != 0) {
-    std::queue<Node*> fifo;
-    fifo.push(m_root);
-    while (!fifo.empty()) {
-      Node* curNode = fifo.front();
-      fifo.pop();
-
-      if (curNode->area < tMin || curNode->area > tMax) {
-        curNode->active = false;
-      }
-
-      for (int i = 0; i < curNode->childs.size(); i++) {
-        fifo.push(curNode->childs[i]);
-      }
-    }
-  }
-  return 0;
+  return filter(
+      [tMin, tMax](const Node& n) {
+        return n.active && n.area >= tMin && n.area <= tMax;
+      },
+      ComputedAttributes::AREA);
 }
 
 template <class T>
 int ComponentTree<T>::volumicFiltering(int tMin, int tMax) {
-  if (m_root != 0) {
-    std::queue<Node*> fifo;
-    fifo.push(m_root);
-    while (!fifo.empty()) {
-      Node* curNode = fifo.front();
-      fifo.pop();
-
-      if (curNode->volume < tMin || curNode->volume > tMax) {
-        curNode->active = false;
-      }
-
-      for (int i = 0; i < curNode->childs.size(); i++) {
-        fifo.push(curNode->childs[i]);
-      }
-    }
-  }
+  return filter(
+      [tMin, tMax](const Node& n) {
+        return n.active && n.volume >= tMin && n.volume <= tMax;
+      },
+      ComputedAttributes::VOLUME);
 }
 
 template <class T>
 int ComponentTree<T>::contrastFiltering(int tMin, int tMax) {
-  if (m_root != 0) {
-    std::queue<Node*> fifo;
-    fifo.push(m_root);
+  return filter(
+      [tMin, tMax](const Node& n) {
+        return n.active && n.contrast >= tMin && n.contrast <= tMax;
+      },
+      ComputedAttributes::CONTRAST);
+}
 
-    while (!fifo.empty()) {
-      Node* curNode = fifo.front();
-      fifo.pop();
-      if (curNode->contrast < tMin || curNode->contrast > tMax) {
-        curNode->active = false;
-      }
+template <class T>
+template <class Predicate>
+int ComponentTree<T>::filter(Predicate keep, int ca) {
+  computeAttributes(ca);
+  for (int i = 0; i < m_nodes.size(); i++)
+    m_nodes[i]->active = keep(*(const Node*)m_nodes[i]);
+  return 0;
+}
 
-      for (int i = 0; i < curNode->childs.size(); i++) {
-        fifo.push(curNode->childs[i]);
-      }
-    }
-  }
+template <class T>
+template <class Predicate>
+int ComponentTree<T>::filterById(Predicate keep, int ca) {
+  computeAttributes(ca);
+  int size = m_nodes.size();
+  std::vector<unsigned char> mask(size);
+  for (int i = 0; i < size; i++) mask[i] = keep(i) ? 1 : 0;
+  for (int i = 0; i < size; i++) m_nodes[i]->active = mask[i];
   return 0;
 }
 
@@ -914,6 +2153,19 @@ Node* ComponentTree<T>::coordToNode(TCoord x, TCoord y, TCoord z) {
   return offsetToNode(offset);
 }
 
+template <class T>
+void ComponentTree<T>::coordToNode(const std::vector<Point<TCoord> >& points,
+                                   std::vector<Node*>& res) {
+  res.resize(points.size());
+  for (std::size_t i = 0; i < points.size(); i++) {
+    const Point<TCoord>& p = points[i];
+    bool inside = p.x >= 0 && p.x < m_img.getSizeX() && p.y >= 0 &&
+                  p.y < m_img.getSizeY() && p.z >= 0 &&
+                  p.z < m_img.getSizeZ();
+    res[i] = inside ? offsetToNode(m_img.getOffset(p.x, p.y, p.z)) : 0;
+  }
+}
+
 template <class T>
 Node* ComponentTree<T>::indexedCoordToNode(TCoord x, TCoord y, TCoord z,
                                            std::vector<Node*>& nodes) {
@@ -923,49 +2175,24 @@ Node* ComponentTree<T>::indexedCoordToNode(TCoord x, TCoord y, TCoord z,
 
 template <class T>
 std::vector<Node*> ComponentTree<T>::indexedNodes() {
-  unsigned int img_size =
-      m_img.getSizeX() * m_img.getSizeY() * m_img.getSizeZ();
-  std::vector<Node*> index(img_size);
-
-  std::queue<Node*> fifo;
-  fifo.push(m_root);
-
-  while (!fifo.empty()) {
-    Node* n = fifo.front();
-    fifo.pop();
-
-    if (n != 0) {
-      Node::ContainerPixels::iterator it;
-      for (it = n->pixels.begin(); it != n->pixels.end(); ++it) {
-        index[*it] = n;
-      }
-      Node::ContainerChilds::iterator jt;
-      for (jt = n->childs.begin(); jt != n->childs.end(); ++jt) fifo.push(*jt);
-    }
-  }
+  TOffset size = m_nodeIds.size();
+  std::vector<Node*> index(size);
+  for (TOffset p = 0; p < size; p++) index[p] = m_nodes[m_nodeIds[p]];
   return index;
 }
 
 template <class T>
 Node* ComponentTree<T>::offsetToNode(TOffset offset) {
-  Node* res = 0;
-  std::queue<Node*> fifo;
-  fifo.push(m_root);
-
-  while (!fifo.empty()) {
-    Node* n = fifo.front();
-    fifo.pop();
+  if (offset < 0 || offset >= (TOffset)m_nodeIds.size()) return 0;
+  return m_nodes[m_nodeIds[offset]];
+}
 
-    if (n != 0) {
-      Node::ContainerPixels::iterator it;
-      for (it = n->pixels.begin(); it != n->pixels.end(); ++it) {
-        if (*it == offset) return n;
-      }
-      Node::ContainerChilds::iterator jt;
-      for (jt = n->childs.begin(); jt != n->childs.end(); ++jt) fifo.push(*jt);
-    }
-  }
-  return res;
+template <class T>
+void ComponentTree<T>::offsetToNode(const std::vector<TOffset>& offsets,
+                                    std::vector<Node*>& res) {
+  res.resize(offsets.size());
+  for (std::size_t i = 0; i < offsets.size(); i++)
+    res[i] = offsetToNode(offsets[i]);
 }
 
 //////////////////////////////////////////////////////////////
@@ -1017,18 +2244,23 @@ void SalembierRecursiveImplementation<T>::computeAreaDerivative(Node* tree) {
     for (it = tree->childs.begin(); it != tree->childs.end(); ++it) {
       computeAreaDerivative(*it);
     }
-    tree->area_derivative_areaN_h =
-        (((long double)(tree->father->area - tree->area)) /
-         ((long double)(tree->h - tree->father->h))) /
-        ((long double)(tree->area));
-    tree->area_derivative_h = ((long double)(tree->father->area - tree->area)) /
-                              ((long double)(tree->h - tree->father->h));
-    tree->area_derivative_areaN =
-        ((long double)(tree->father->area - tree->area)) /
-        ((long double)(tree->area));
+    nodeAreaDerivative(tree);
   }
 }
 
+template <class T>
+void SalembierRecursiveImplementation<T>::nodeAreaDerivative(Node* tree) {
+  tree->area_derivative_areaN_h =
+      (((long double)(tree->father->area - tree->area)) /
+       ((long double)(tree->h - tree->father->h))) /
+      ((long double)(tree->area));
+  tree->area_derivative_h = ((long double)(tree->father->area - tree->area)) /
+                            ((long double)(tree->h - tree->father->h));
+  tree->area_derivative_areaN =
+      ((long double)(tree->father->area - tree->area)) /
+      ((long double)(tree->area));
+}
+
 template <class T>
 void SalembierRecursiveImplementation<T>::computeAreaDerivative2(Node* tree) {
   if (tree != 0) {
@@ -1049,39 +2281,41 @@ void SalembierRecursiveImplementation<T>::computeMSER(Node* tree,
     for (it = tree->childs.begin(); it != tree->childs.end(); ++it) {
       computeMSER(*it, delta);
     }
+    nodeMSER(tree, delta);
+  }
+}
 
-    tree->mser = std::numeric_limits<long double>::max();
-    tree->area_derivative_delta_h = std::numeric_limits<long double>::max();
-    tree->area_derivative_delta_areaF = std::numeric_limits<long double>::max();
-
-    Node node = *tree;
-
-    int64_t area_node, area_father;
-    int h_node, h_father;
+template <class T>
+void SalembierRecursiveImplementation<T>::nodeMSER(Node* tree,
+                                                   unsigned int delta) {
+  tree->mser = std::numeric_limits<long double>::max();
+  tree->area_derivative_delta_h = std::numeric_limits<long double>::max();
+  tree->area_derivative_delta_areaF = std::numeric_limits<long double>::max();
 
-    area_node = node.area;
-    h_node = node.h;
+  const Node* node = tree;
 
-    area_father = node.father->area;
-    h_father = node.father->h;
+  int64_t area_node, area_father;
+  int h_node, h_father;
 
-    while ((h_node - node.h < (int)delta) &&
-           (node.father != node.father->father)) {
-      node = *node.father;
-    }
+  area_node = node->area;
+  h_node = node->h;
 
-    if ((h_node - node.h) >= (int)delta) {
-      area_father = node.area;
-      h_father = node.h;
+  while ((h_node - node->h < (int)delta) &&
+         (node->father != node->father->father)) {
+    node = node->father;
+  }
 
-      tree->mser =
-          ((long double)(area_father - area_node)) / ((long double)(area_node));
-      tree->area_derivative_delta_h = ((long double)(area_father - area_node)) /
-                                      ((long double)(h_node - h_father));
-      tree->area_derivative_delta_areaF =
-          ((long double)(area_father - area_node)) /
-          ((long double)(area_father));
-    }
+  if ((h_node - node->h) >= (int)delta) {
+    area_father = node->area;
+    h_father = node->h;
+
+    tree->mser =
+        ((long double)(area_father - area_node)) / ((long double)(area_node));
+    tree->area_derivative_delta_h = ((long double)(area_father - area_node)) /
+                                    ((long double)(h_node - h_father));
+    tree->area_derivative_delta_areaF =
+        ((long double)(area_father - area_node)) /
+        ((long double)(area_father));
   }
 }
 
@@ -1195,24 +2429,40 @@ int SalembierRecursiveImplementation<T>::computeVolume(Node* tree) {
     return -1;
 }
 
+template <class T>
+void SalembierRecursiveImplementation<T>::computeGradient() {
+  // original image, read on the nodes of the pixels
+  const std::vector<Node*>& nodes = this->m_parent->m_nodes;
+  const std::vector<int32_t>& ids = this->m_parent->m_nodeIds;
+  Image<T> im(oriSize);
+  for (TOffset p = 0; p < ids.size(); p++) im(p) = (T)nodes[ids[p]]->ori_h;
+  imGradient = morphologicalGradient(im, connexity);
+  gradientComputed = true;
+}
+
 template <class T>
 void SalembierRecursiveImplementation<T>::computeBorderGradient(Node* tree) {
+  if (!gradientComputed) computeGradient();
   if (tree != 0) {
     Node::ContainerChilds::iterator it;
     for (it = tree->childs.begin(); it != tree->childs.end(); ++it) {
       computeBorderGradient(*it);
     }
+    nodeBorderGradient(tree);
+  }
+}
 
-    long double sum = 0;
-
-    Node::ContainerPixels::iterator itpix;
-    for (itpix = tree->pixels_border.begin();
-         itpix != tree->pixels_border.end(); ++itpix) {
-      sum += imGradient(*itpix);
-    }
+template <class T>
+void SalembierRecursiveImplementation<T>::nodeBorderGradient(Node* tree) {
+  long double sum = 0;
 
-    tree->mean_gradient_border = sum / tree->pixels_border.size();
+  Node::ContainerPixels::iterator itpix;
+  for (itpix = tree->pixels_border.begin(); itpix != tree->pixels_border.end();
+       ++itpix) {
+    sum += imGradient(*itpix);
   }
+
+  tree->mean_gradient_border = sum / tree->pixels_border.size();
 }
 
 /** @brief Compute contour length
@@ -1230,83 +2480,85 @@ void SalembierRecursiveImplementation<T>::computeBorderGradient(Node* tree) {
 
 template <class T>
 int SalembierRecursiveImplementation<T>::computeContour(bool save_pixels) {
-  // we compute the contour length with STATUS image and m_img
-  typename Image<T>::iterator it;
-  typename Image<T>::iterator end = imBorder.end();
-
-  this->se.setContext(imBorder.getSize());
+  // we compute the contour length with the node ids of the pixels and the
+  // original levels of their nodes
+  const std::vector<Node*>& nodes = this->m_parent->m_nodes;
+  const int32_t* ids = &this->m_parent->m_nodeIds[0];
+
+  int nbPoints = connexity.getNbPoints();
+  std::vector<TOffset> neighbors(nbPoints);
+  for (int j = 0; j < nbPoints; j++) {
+    Point<TCoord> q = connexity.getPoint(j);
+    neighbors[j] = q.x + q.y * oriSize[0] + q.z * oriSize[0] * oriSize[1];
+  }
 
-  FlatSE::iterator itSE;
-  FlatSE::iterator seEnd = se.end();
-  ;
+  // contour lengths are accumulated: start again from scratch
+  if (contourComputed) {
+    for (int i = 0; i < nodes.size(); i++) {
+      nodes[i]->contourLength = 0;
+      nodes[i]->pixels_border.clear();
+    }
+  }
+  contourComputed = true;
+  contourPixelsSaved = save_pixels;
 
   TOffset offset = 0;
-  for (it = imBorder.begin(); it != end; ++it, offset++) {
-    bool contour = false;
-    bool hitsBorder = false;
-    T minValue = std::numeric_limits<T>::max();
-
-    if (STATUS(offset) != BORDER_STATUS) {
-      for (itSE = se.begin(); itSE != seEnd; ++itSE) {
-        TOffset q = offset + *itSE;
-        if (STATUS(q) != BORDER_STATUS) {
-          if (*it > imBorder(q)) {
-            contour = true;
-            if (imBorder(q) < minValue) minValue = imBorder(q);
+  for (TCoord z = 0; z < oriSize[2]; z++)
+    for (TCoord y = 0; y < oriSize[1]; y++)
+      for (TCoord x = 0; x < oriSize[0]; x++, offset++) {
+        bool contour = false;
+        bool hitsBorder = false;
+        int value = nodes[ids[offset]]->ori_h;
+        int minValue = std::numeric_limits<int>::max();
+
+        // all the neighbors of an inner pixel are in the image
+        bool inner = x >= back[0] && x < oriSize[0] - front[0] &&
+                     y >= back[1] && y < oriSize[1] - front[1] &&
+                     z >= back[2] && z < oriSize[2] - front[2];
+        for (int j = 0; j < nbPoints; j++) {
+          if (!inner) {
+            Point<TCoord> q = connexity.getPoint(j);
+            q.x += x;
+            q.y += y;
+            q.z += z;
+            if (q.x < 0 || q.x >= oriSize[0] || q.y < 0 ||
+                q.y >= oriSize[1] || q.z < 0 || q.z >= oriSize[2]) {
+              // a neighbor of border is a contour point
+              // we must propagate this until level Min
+              contour = true;
+              hitsBorder = true;
+              continue;
+            }
           }
-        } else if (STATUS(q) == BORDER_STATUS) {
-          // a neighbor of border is a contour point
-          // we must propagate this until level Min
-          contour = true;
-          hitsBorder = true;
-          minValue = this->hMin;
-        }
-      }
-    }
-    if (contour == true)
-    // for all the nodes of levels *it->minValue+1, update contour length
-    {
-      Node* tmp = index[hToIndex(*it)][STATUS(offset)];
-      assert(tmp != 0);
-      if (hitsBorder == false)
-        while (tmp->h > minValue) {
-          tmp->contourLength++;
-          if (save_pixels) {
-            // conversion offset imBorder->im
-            Point<TCoord> imCoord = imBorder.getCoord(offset);
-            imCoord.x -= back[0];
-            imCoord.y -= back[1];
-            imCoord.z -= back[2];
-            TOffset imOffset = imCoord.x + imCoord.y * oriSize[0] +
-                               imCoord.z * oriSize[0] * oriSize[1];
-
-            tmp->pixels_border.push_back(imOffset);
+          int neighborValue = nodes[ids[offset + neighbors[j]]]->ori_h;
+          if (value > neighborValue) {
+            contour = true;
+            if (neighborValue < minValue) minValue = neighborValue;
           }
-          tmp = tmp->father;
         }
-      else {
-        bool stop = false;
-        while (!stop) {
-          tmp->contourLength++;
-          if (save_pixels) {
-            // conversion offset imBorder->im
-            Point<TCoord> imCoord = imBorder.getCoord(offset);
-            imCoord.x -= back[0];
-            imCoord.y -= back[1];
-            imCoord.z -= back[2];
-            TOffset imOffset = imCoord.x + imCoord.y * oriSize[0] +
-                               imCoord.z * oriSize[0] * oriSize[1];
-
-            tmp->pixels_border.push_back(imOffset);
+        if (contour == true)
+        // for all the nodes of levels value->minValue+1, update contour length
+        {
+          Node* tmp = nodes[ids[offset]];
+          if (hitsBorder == false)
+            while (tmp->h > minValue) {
+              tmp->contourLength++;
+              if (save_pixels) tmp->pixels_border.push_back(offset);
+              tmp = tmp->father;
+            }
+          else {
+            bool stop = false;
+            while (!stop) {
+              tmp->contourLength++;
+              if (save_pixels) tmp->pixels_border.push_back(offset);
+              if (tmp != tmp->father)
+                tmp = tmp->father;
+              else
+                stop = true;
+            }
           }
-          if (tmp != tmp->father)
-            tmp = tmp->father;
-          else
-            stop = true;
         }
       }
-    }
-  }
   return 1;
 }
 
@@ -1321,14 +2573,7 @@ int SalembierRecursiveImplementation<T>::computeComplexityAndCompacity(
       Node* n = fifo.front();
       fifo.pop();
 
-      if (n->area != 0)
-        n->complexity = (int)(1000.0 * n->contourLength / n->area);
-      if (n->contourLength != 0) {
-        n->compacity = (int)(((double)(4 * M_PI * n->area) /
-                              ((double)n->contourLength * n->contourLength)) *
-                             1000);
-      } else
-        n->compacity = 0;
+      nodeComplexityAndCompacity(n);
       std::vector<Node*>::iterator it;
       for (it = n->childs.begin(); it != n->childs.end(); ++it) fifo.push(*it);
     }
@@ -1339,6 +2584,17 @@ int SalembierRecursiveImplementation<T>::computeComplexityAndCompacity(
     return -1;
 }
 
+template <class T>
+void SalembierRecursiveImplementation<T>::nodeComplexityAndCompacity(Node* n) {
+  if (n->area != 0) n->complexity = (int)(1000.0 * n->contourLength / n->area);
+  if (n->contourLength != 0) {
+    n->compacity = (int)(((double)(4 * M_PI * n->area) /
+                          ((double)n->contourLength * n->contourLength)) *
+                         1000);
+  } else
+    n->compacity = 0;
+}
+
 template <class T>
 int SalembierRecursiveImplementation<T>::computeBoundingBox(Node* tree) {
   std::queue<Node*> fifo;
@@ -1404,21 +2660,34 @@ void SalembierRecursiveImplementation<T>::computeAttributes(
 template <class T>
 void SalembierRecursiveImplementation<T>::computeAttributes(
     Node* tree, ComputedAttributes ca, unsigned int delta) {
+  if (tree != 0 && tree == m_parent->m_root && m_parent->m_scheduler != 0) {
+    computeAttributesParallel(ca, delta, *m_parent->m_scheduler);
+    return;
+  }
   if (tree != 0) {
+    // derived attributes finalised by the vectorised kernels
+    int vectorized = 0;
+    if (tree == m_parent->m_root && m_parent->m_vectorized)
+      vectorized = ca & VECTORIZED_ATTRIBUTES;
+
     if (ca & ComputedAttributes::AREA) {
       tree->area = computeArea(tree);
-
-      if (ca & ComputedAttributes::OTSU) {
-        tree->sum = computeSum(tree);
-        tree->sum_square = computeSumSquare(tree);
+    }
+    // requires area
+    if (ca & ComputedAttributes::OTSU) {
+      tree->sum = computeSum(tree);
+      tree->sum_square = computeSumSquare(tree);
+      if (!vectorized) {
         computeMean(tree);
         computeVariance(tree);
         computeOtsu(tree);
       }
     }
     if (ca & ComputedAttributes::AREA_DERIVATIVES) {
-      computeAreaDerivative(tree);
-      computeAreaDerivative2(tree);
+      if (!vectorized) {
+        computeAreaDerivative(tree);
+        computeAreaDerivative2(tree);
+      }
       computeMSER(tree, delta);
     }
     if (ca & ComputedAttributes::CONTRAST) {
@@ -1428,16 +2697,15 @@ void SalembierRecursiveImplementation<T>::computeAttributes(
       tree->volume = computeVolume(tree);
     }
     if (ca & ComputedAttributes::BORDER_GRADIENT) {
-      computeContour(true);
+      if (!contourPixelsSaved) computeContour(true);
       computeBorderGradient(tree);
+      // the gradient image is only read here: computed again if needed
+      imGradient = Image<T>();
+      gradientComputed = false;
     }
     if (ca & ComputedAttributes::COMP_LEXITY_ACITY) {
-      if (ca & ComputedAttributes::BORDER_GRADIENT) {
-        computeComplexityAndCompacity(tree);
-      } else {
-        computeContour();
-        computeComplexityAndCompacity(tree);
-      }
+      if (!contourComputed) computeContour();
+      if (!vectorized) computeComplexityAndCompacity(tree);
     }
     if (ca & ComputedAttributes::BOUNDING_BOX) {
       computeBoundingBox(tree);
@@ -1445,6 +2713,282 @@ void SalembierRecursiveImplementation<T>::computeAttributes(
     if (ca & ComputedAttributes::SUB_NODES) {
       tree->subNodes = computeSubNodes(tree);
     }
+    if (vectorized) computeAttributesVectorized(vectorized, 0);
+  }
+}
+
+// Parallel computation
+// Bottom-up attributes (area, sums, contrast, volume, bounding box, number of
+// sub-nodes) are computed by a post-order pass where large sibling subtrees
+// are tasks of the scheduler. The other attributes only read the node and its
+// ancestors: they are computed by parallel loops over the nodes.
+// Each node is computed with the same operations as the sequential functions,
+// so the results are identical.
+
+template <class T>
+void SalembierRecursiveImplementation<T>::mergeSons(Node* tree, int ca) {
+  int current_max = 0;
+  Node::ContainerChilds::iterator it;
+  for (it = tree->childs.begin(); it != tree->childs.end(); ++it) {
+    Node* son = *it;
+    if (ca & ComputedAttributes::AREA) tree->area += son->area;
+    if (ca & ComputedAttributes::OTSU) {
+      tree->sum += son->sum;
+      tree->sum_square += son->sum_square;
+    }
+    if (ca & ComputedAttributes::CONTRAST)
+      current_max = std::max(current_max, (son->h - tree->h) + son->contrast);
+    if (ca & ComputedAttributes::BOUNDING_BOX) {
+      tree->xmin = std::min(tree->xmin, son->xmin);
+      tree->xmax = std::max(tree->xmax, son->xmax);
+      tree->ymin = std::min(tree->ymin, son->ymin);
+      tree->ymax = std::max(tree->ymax, son->ymax);
+      tree->zmin = std::min(tree->zmin, son->zmin);
+      tree->zmax = std::max(tree->zmax, son->zmax);
+    }
+  }
+  if (ca & ComputedAttributes::CONTRAST) tree->contrast = current_max;
+  // requires area
+  if (ca & ComputedAttributes::VOLUME) {
+    int local_contrast = 0;
+    if (tree->father == tree)
+      local_contrast = tree->h;
+    else
+      local_contrast = tree->h - tree->father->h;
+
+    tree->volume = (int)tree->area * local_contrast;
+    for (it = tree->childs.begin(); it != tree->childs.end(); ++it)
+      tree->volume += (*it)->volume;
+  }
+  // same count as computeSubNodes
+  if ((ca & ComputedAttributes::SUB_NODES) && !tree->childs.empty())
+    tree->subNodes = tree->childs.size() + tree->childs.back()->subNodes;
+}
+
+template <class T>
+void SalembierRecursiveImplementation<T>::mergeSubtree(Node* tree, int ca) {
+  Node::ContainerChilds::iterator it;
+  for (it = tree->childs.begin(); it != tree->childs.end(); ++it)
+    mergeSubtree(*it, ca);
+  mergeSons(tree, ca);
+}
+
+template <class T>
+void SalembierRecursiveImplementation<T>::mergeSubtreeParallel(
+    Node* tree, int ca, const std::vector<int>& sizes,
+    TaskScheduler& scheduler) {
+  TaskScheduler::TaskGroup group;
+  // small sons are grouped in tasks of about PARALLEL_GRAIN nodes
+  std::vector<Node*> batch;
+  int batchSize = 0;
+
+  Node::ContainerChilds::iterator it;
+  for (it = tree->childs.begin(); it != tree->childs.end(); ++it) {
+    Node* son = *it;
+    if (sizes[son->id] > PARALLEL_GRAIN) {
+      scheduler.spawn(group, [this, son, ca, &sizes, &scheduler] {
+        mergeSubtreeParallel(son, ca, sizes, scheduler);
+      });
+      continue;
+    }
+    batch.push_back(son);
+    batchSize += sizes[son->id];
+    if (batchSize > PARALLEL_GRAIN) {
+      scheduler.spawn(group, [this, batch, ca] {
+        for (int i = 0; i < batch.size(); i++) mergeSubtree(batch[i], ca);
+      });
+      batch.clear();
+      batchSize = 0;
+    }
+  }
+  for (int i = 0; i < batch.size(); i++) mergeSubtree(batch[i], ca);
+
+  scheduler.wait(group);
+  mergeSons(tree, ca);
+}
+
+template <class T>
+void SalembierRecursiveImplementation<T>::nodeStatistics(Node* tree) {
+  tree->mean = (long double)tree->sum / (long double)tree->area;
+  tree->variance = ((long double)tree->sum_square / (long double)tree->area) -
+                   tree->mean * tree->mean;
+  tree->otsu =
+      ((tree->mean - tree->mean_nghb) * (tree->mean - tree->mean_nghb)) /
+      (tree->variance + tree->variance_nghb);
+}
+
+template <class T>
+void SalembierRecursiveImplementation<T>::computeAttributesParallel(
+    int ca, unsigned int delta, TaskScheduler& scheduler) {
+  std::vector<Node*>& nodes = m_parent->m_nodes;
+  Node* root = m_parent->m_root;
+
+  // number of nodes of each subtree (fathers precede their sons)
+  std::vector<int> sizes(nodes.size(), 1);
+  for (int i = nodes.size() - 1; i > 0; i--)
+    sizes[nodes[i]->father->id] += sizes[i];
+
+  int bottomUp = ca & (ComputedAttributes::AREA | ComputedAttributes::OTSU |
+                       ComputedAttributes::CONTRAST |
+                       ComputedAttributes::VOLUME |
+                       ComputedAttributes::BOUNDING_BOX |
+                       ComputedAttributes::SUB_NODES);
+  if (bottomUp) {
+    if (sizes[root->id] > PARALLEL_GRAIN)
+      mergeSubtreeParallel(root, bottomUp, sizes, scheduler);
+    else
+      mergeSubtree(root, bottomUp);
+  }
+
+  // image scans stay sequential
+  if ((ca & ComputedAttributes::BORDER_GRADIENT) && !contourPixelsSaved)
+    computeContour(true);
+  if ((ca & ComputedAttributes::COMP_LEXITY_ACITY) && !contourComputed)
+    computeContour();
+  if ((ca & ComputedAttributes::BORDER_GRADIENT) && !gradientComputed)
+    computeGradient();
+
+  int vectorized = m_parent->m_vectorized ? ca & VECTORIZED_ATTRIBUTES : 0;
+  int perNode = ca & ~vectorized;
+
+  scheduler.parallelFor(0, nodes.size(), PARALLEL_GRAIN, [&](std::size_t i) {
+    Node* n = nodes[i];
+    if (perNode & ComputedAttributes::OTSU) nodeStatistics(n);
+    if (ca & ComputedAttributes::AREA_DERIVATIVES) {
+      if (perNode & ComputedAttributes::AREA_DERIVATIVES)
+        nodeAreaDerivative(n);
+      nodeMSER(n, delta);
+    }
+    if (perNode & ComputedAttributes::BORDER_GRADIENT) nodeBorderGradient(n);
+    if (perNode & ComputedAttributes::COMP_LEXITY_ACITY)
+      nodeComplexityAndCompacity(n);
+  });
+  if (ca & ComputedAttributes::BORDER_GRADIENT) {
+    imGradient = Image<T>();
+    gradientComputed = false;
+  }
+  if (vectorized) computeAttributesVectorized(vectorized, &scheduler);
+  // requires the area derivative of the father
+  if (perNode & ComputedAttributes::AREA_DERIVATIVES) {
+    scheduler.parallelFor(0, nodes.size(), PARALLEL_GRAIN, [&](std::size_t i) {
+      Node* n = nodes[i];
+      n->area_derivative_areaN_h_derivative =
+          n->father->area_derivative_areaN_h - n->area_derivative_areaN_h;
+    });
+  }
+}
+
+// Vectorised computation
+// The inputs of the derived attributes are gathered by blocks of nodes into
+// contiguous arrays, finalised by AttributeKernels and scattered back.
+// The kernels work in double precision (instead of long double): complexity
+// and compacity are identical, the other attributes may differ in the last
+// digits.
+
+template <class T>
+void SalembierRecursiveImplementation<T>::finalizeBlock(int ca,
+                                                        std::size_t first,
+                                                        std::size_t last) {
+  std::vector<Node*>& nodes = m_parent->m_nodes;
+  std::size_t n = last - first;
+  std::vector<double> area(n);
+  for (std::size_t i = 0; i < n; i++) area[i] = nodes[first + i]->area;
+
+  if (ca & ComputedAttributes::OTSU) {
+    std::vector<double> sum(n), sumSquare(n), meanNghb(n), varianceNghb(n);
+    std::vector<double> mean(n), variance(n), otsu(n);
+    for (std::size_t i = 0; i < n; i++) {
+      Node* node = nodes[first + i];
+      sum[i] = node->sum;
+      sumSquare[i] = node->sum_square;
+      meanNghb[i] = node->mean_nghb;
+      varianceNghb[i] = node->variance_nghb;
+    }
+    AttributeKernels::statistics(n, &area[0], &sum[0], &sumSquare[0],
+                                 &meanNghb[0], &varianceNghb[0], &mean[0],
+                                 &variance[0], &otsu[0]);
+    for (std::size_t i = 0; i < n; i++) {
+      Node* node = nodes[first + i];
+      node->mean = mean[i];
+      node->variance = variance[i];
+      node->otsu = otsu[i];
+    }
+  }
+  if (ca & ComputedAttributes::AREA_DERIVATIVES) {
+    std::vector<double> fatherArea(n), h(n), fatherH(n);
+    std::vector<double> derivativeAreaN_h(n), derivativeH(n),
+        derivativeAreaN(n);
+    for (std::size_t i = 0; i < n; i++) {
+      Node* node = nodes[first + i];
+      fatherArea[i] = node->father->area;
+      h[i] = node->h;
+      fatherH[i] = node->father->h;
+    }
+    AttributeKernels::areaDerivatives(n, &area[0], &fatherArea[0], &h[0],
+                                      &fatherH[0], &derivativeAreaN_h[0],
+                                      &derivativeH[0], &derivativeAreaN[0]);
+    for (std::size_t i = 0; i < n; i++) {
+      Node* node = nodes[first + i];
+      node->area_derivative_areaN_h = derivativeAreaN_h[i];
+      node->area_derivative_h = derivativeH[i];
+      node->area_derivative_areaN = derivativeAreaN[i];
+    }
+  }
+  if (ca & ComputedAttributes::COMP_LEXITY_ACITY) {
+    std::vector<double> contourLength(n);
+    std::vector<int> complexity(n), compacity(n);
+    for (std::size_t i = 0; i < n; i++) {
+      contourLength[i] = nodes[first + i]->contourLength;
+      complexity[i] = nodes[first + i]->complexity;
+    }
+    AttributeKernels::complexityAndCompacity(n, &contourLength[0], &area[0],
+                                             &complexity[0], &compacity[0]);
+    for (std::size_t i = 0; i < n; i++) {
+      nodes[first + i]->complexity = complexity[i];
+      nodes[first + i]->compacity = compacity[i];
+    }
+  }
+}
+
+template <class T>
+void SalembierRecursiveImplementation<T>::finalizeDerivativeBlock(
+    std::size_t first, std::size_t last) {
+  std::vector<Node*>& nodes = m_parent->m_nodes;
+  std::size_t n = last - first;
+  std::vector<double> father(n), node(n), derivative(n);
+  for (std::size_t i = 0; i < n; i++) {
+    father[i] = nodes[first + i]->father->area_derivative_areaN_h;
+    node[i] = nodes[first + i]->area_derivative_areaN_h;
+  }
+  AttributeKernels::difference(n, &father[0], &node[0], &derivative[0]);
+  for (std::size_t i = 0; i < n; i++)
+    nodes[first + i]->area_derivative_areaN_h_derivative = derivative[i];
+}
+
+template <class T>
+void SalembierRecursiveImplementation<T>::computeAttributesVectorized(
+    int ca, TaskScheduler* scheduler) {
+  std::size_t nbNodes = m_parent->m_nodes.size();
+  std::size_t nbBlocks = (nbNodes + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN;
+
+  std::function<void(std::size_t)> finalize = [&](std::size_t b) {
+    finalizeBlock(ca, b * PARALLEL_GRAIN,
+                  std::min(nbNodes, (b + 1) * PARALLEL_GRAIN));
+  };
+  // requires the area derivative of the father
+  std::function<void(std::size_t)> derivative = [&](std::size_t b) {
+    finalizeDerivativeBlock(b * PARALLEL_GRAIN,
+                            std::min(nbNodes, (b + 1) * PARALLEL_GRAIN));
+  };
+
+  if (scheduler != 0) {
+    scheduler->parallelFor(0, nbBlocks, 1, finalize);
+    if (ca & ComputedAttributes::AREA_DERIVATIVES)
+      scheduler->parallelFor(0, nbBlocks, 1, derivative);
+  } else {
+    for (std::size_t b = 0; b < nbBlocks; b++) finalize(b);
+    if (ca & ComputedAttributes::AREA_DERIVATIVES)
+      for (std::size_t b = 0; b < nbBlocks; b++) derivative(b);
   }
 }
 
@@ -1467,6 +3011,9 @@ inline void SalembierRecursiveImplementation<T>::update_attributes(
   n->sum += n->h;
   n->sum_square += (n->h * n->h);
 
+  for (int i = 0; i < accumulators.size(); i++)
+    accumulators[i]->addPixel(n, imCoord, n->h);
+
   if (imCoord.x < n->xmin) n->xmin = imCoord.x;
   if (imCoord.x > n->xmax) n->xmax = imCoord.x;
 
@@ -1557,19 +3104,26 @@ Node* SalembierRecursiveImplementation<T>::computeTree() {
 
   Node* root = index[hToIndex(hMin)][0];
 
-  // crop STATUS image to recover original dimensions
-
-  this->m_parent->STATUS =
-      this->STATUS.crop(back[0], this->STATUS.getSizeX() - front[0], back[1],
-                        this->STATUS.getSizeY() - front[1], back[2],
-                        this->STATUS.getSizeZ() - front[2]);
+  orderNodes(root);
 
-  this->m_parent->index = this->index;
   this->m_parent->hMin = this->hMin;
 
+  releaseConstructionBuffers();
+
   return root;
 }
 
+template <class T>
+void SalembierRecursiveImplementation<T>::releaseConstructionBuffers() {
+  imBorder = Image<T>();
+  STATUS = Image<int>();
+  delete[] hq;
+  hq = 0;
+  IndexType().swap(index);
+  vector<int>().swap(number_nodes);
+  vector<bool>().swap(node_at_level);
+}
+
 // initialize global index for nodes
 template <class T>
 void SalembierRecursiveImplementation<T>::init(Image<T>& img,
@@ -1587,7 +3141,7 @@ void SalembierRecursiveImplementation<T>::init(Image<T>& img,
   }
 
   imBorder = img;
-  imGradient = morphologicalGradient(img, connexity);
+  this->connexity = connexity;
   STATUS.setSize(img.getSize());
   STATUS.fill(ACTIVE);
 
@@ -1640,6 +3194,40 @@ void SalembierRecursiveImplementation<T>::init(Image<T>& img,
   delete[] histo;
 }
 
+// number nodes in breadth-first order (fathers before sons) and
+// finalize accumulators, whose states were indexed by creation order
+template <class T>
+void SalembierRecursiveImplementation<T>::orderNodes(Node* root) {
+  std::vector<Node*>& nodes = this->m_parent->m_nodes;
+  nodes.clear();
+  nodes.reserve(totalNodes);
+  nodes.push_back(root);
+  for (int i = 0; i < nodes.size(); i++) {
+    Node::ContainerChilds::iterator it;
+    for (it = nodes[i]->childs.begin(); it != nodes[i]->childs.end(); ++it)
+      nodes.push_back(*it);
+  }
+
+  std::vector<int> oldIds(nodes.size());
+  for (int i = 0; i < nodes.size(); i++) {
+    oldIds[i] = nodes[i]->id;
+    nodes[i]->id = i;
+  }
+
+  std::vector<int32_t>& nodeIds = this->m_parent->m_nodeIds;
+  nodeIds.resize(this->m_parent->m_img.getBufSize());
+  for (int i = 0; i < nodes.size(); i++) {
+    Node::ContainerPixels& pixels = nodes[i]->pixels;
+    for (std::size_t p = 0; p < pixels.size(); p++) nodeIds[pixels[p]] = i;
+  }
+
+  for (int i = 0; i < accumulators.size(); i++) {
+    accumulators[i]->reorder(oldIds);
+    accumulators[i]->merge(nodes);
+  }
+  accumulators.clear();
+}
+
 template <class T>
 void SalembierRecursiveImplementation<T>::link_node(Node* tree, Node* child) {
   child->father = tree;
@@ -1652,6 +3240,9 @@ Node* SalembierRecursiveImplementation<T>::new_node(int h, int n) {
   res->ori_h = h;
   res->h = h;
   res->label = n;
+  res->id = totalNodes++;
+
+  for (int i = 0; i < accumulators.size(); i++) accumulators[i]->newNode(res);
 
   return res;
 }
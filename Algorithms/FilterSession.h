@@ -0,0 +1,100 @@
+/*
+ * This file is part of libTIM.
+ *
+ * Copyright (©) 2005-2013  Benoit Naegel
+ * Copyright (©) 2013 Theo de Carpentier
+ * Copyright (©) 2022-2023  Cyril Meyer
+ */
+
+#ifndef FilterSession_h
+#define FilterSession_h
+
+#include "ComponentTree.h"
+
+namespace LibTIM {
+
+/** @brief Filtering of a component tree without modifying it
+ * A session holds its own activity of the nodes (indexed by Node::id) and
+ * its own output levels, so several sessions can filter the same tree, one
+ * after another or in parallel threads, without rebuilding or restoring it.
+ * The tree is never modified by a session: the attributes read by the
+ * filters are computed beforehand, e.g. by prepare().
+ * Usage:
+ *   FilterSession<U8>::prepare(tree);
+ *   // then in each thread
+ *   FilterSession<U8> session(tree);
+ *   session.areaFiltering(100);
+ *   session.constructImage(res);
+ **/
+template <class T>
+class FilterSession {
+ public:
+  typedef typename ComponentTree<T>::ConstructionDecision ConstructionDecision;
+
+  // all the nodes are active
+  explicit FilterSession(const ComponentTree<T> &tree);
+
+  /**
+   * @brief Compute the attributes of ca (ComputedAttributes mask) on the tree,
+   * by default the ones read by the area, volumic and contrast filterings
+   * Not thread-safe: call it before the sessions are used.
+   **/
+  static int prepare(ComponentTree<T> &tree, int ca = REQUIRED_ATTRIBUTES);
+  static const int REQUIRED_ATTRIBUTES = ComputedAttributes::AREA |
+                                         ComputedAttributes::VOLUME |
+                                         ComputedAttributes::CONTRAST;
+
+  /**
+   * @brief Clear all filtering
+   **/
+  void restore();
+
+  /**
+   * @brief Keep the nodes for which keep(const Node &) is true
+   * (replaces the previous filtering, see ComponentTree::filter)
+   **/
+  template <class Predicate>
+  int filter(Predicate keep);
+  template <class Predicate>
+  int filterById(Predicate keep);
+
+  /**
+   * @brief Area, volumic and contrast filtering (cumulative, as in
+   * ComponentTree)
+   * Return -1 (the filtering being unchanged) if the attribute has not been
+   * computed on the tree.
+   **/
+  int areaFiltering(int64_t tMin,
+                    int64_t tMax = std::numeric_limits<int64_t>::max());
+  int volumicFiltering(int tMin, int tMax = std::numeric_limits<int>::max());
+  int contrastFiltering(int tMin, int tMax = std::numeric_limits<int>::max());
+
+  bool isActive(const Node *n) const { return m_active[n->id]; }
+  void setActive(const Node *n, bool active) { m_active[n->id] = active; }
+
+  /**
+   * @brief Output level of each node (indexed by Node::id)
+   **/
+  const std::vector<int> &computeLevels(
+      ConstructionDecision decision = ComponentTree<T>::MIN);
+
+  Image<T> constructImage(
+      ConstructionDecision decision = ComponentTree<T>::MIN);
+  void constructImage(Image<T> &res,
+                      ConstructionDecision decision = ComponentTree<T>::MIN);
+  // output buffer of the size of the image (see ComponentTree::constructImage)
+  void constructImage(T *res,
+                      ConstructionDecision decision = ComponentTree<T>::MIN);
+
+ private:
+  const ComponentTree<T> &m_tree;
+  // activity bitset, indexed by Node::id
+  std::vector<bool> m_active;
+  // output levels of the last reconstruction, indexed by Node::id
+  std::vector<int> m_levels;
+};
+
+}  // namespace LibTIM
+
+#include "FilterSession.hxx"
+#endif
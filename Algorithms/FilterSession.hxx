@@ -0,0 +1,97 @@
+/*
+ * This file is part of libTIM.
+ *
+ * Copyright (©) 2005-2013  Benoit Naegel
+ * Copyright (©) 2013 Theo de Carpentier
+ * Copyright (©) 2022-2023  Cyril Meyer
+ */
+
+namespace LibTIM {
+
+template <class T>
+FilterSession<T>::FilterSession(const ComponentTree<T>& tree)
+    : m_tree(tree), m_active(tree.m_nodes.size(), true) {}
+
+template <class T>
+int FilterSession<T>::prepare(ComponentTree<T>& tree, int ca) {
+  return tree.computeAttributes(ca);
+}
+
+template <class T>
+void FilterSession<T>::restore() {
+  m_active.assign(m_tree.m_nodes.size(), true);
+}
+
+template <class T>
+template <class Predicate>
+int FilterSession<T>::filter(Predicate keep) {
+  const std::vector<Node*>& nodes = m_tree.m_nodes;
+  for (int i = 0; i < nodes.size(); i++)
+    m_active[i] = keep(*(const Node*)nodes[i]);
+  return 0;
+}
+
+template <class T>
+template <class Predicate>
+int FilterSession<T>::filterById(Predicate keep) {
+  for (int i = 0; i < m_active.size(); i++) m_active[i] = keep(i);
+  return 0;
+}
+
+template <class T>
+int FilterSession<T>::areaFiltering(int64_t tMin, int64_t tMax) {
+  if (!(m_tree.m_computed & ComputedAttributes::AREA)) return -1;
+  const std::vector<Node*>& nodes = m_tree.m_nodes;
+  for (int i = 0; i < nodes.size(); i++)
+    if (nodes[i]->area < tMin || nodes[i]->area > tMax) m_active[i] = false;
+  return 0;
+}
+
+template <class T>
+int FilterSession<T>::volumicFiltering(int tMin, int tMax) {
+  if (!(m_tree.m_computed & ComputedAttributes::VOLUME)) return -1;
+  const std::vector<Node*>& nodes = m_tree.m_nodes;
+  for (int i = 0; i < nodes.size(); i++)
+    if (nodes[i]->volume < tMin || nodes[i]->volume > tMax)
+      m_active[i] = false;
+  return 0;
+}
+
+template <class T>
+int FilterSession<T>::contrastFiltering(int tMin, int tMax) {
+  if (!(m_tree.m_computed & ComputedAttributes::CONTRAST)) return -1;
+  const std::vector<Node*>& nodes = m_tree.m_nodes;
+  for (int i = 0; i < nodes.size(); i++)
+    if (nodes[i]->contrast < tMin || nodes[i]->contrast > tMax)
+      m_active[i] = false;
+  return 0;
+}
+
+template <class T>
+const std::vector<int>& FilterSession<T>::computeLevels(
+    ConstructionDecision decision) {
+  m_tree.computeLevels(decision, m_active, m_levels);
+  return m_levels;
+}
+
+template <class T>
+void FilterSession<T>::constructImage(T* res, ConstructionDecision decision) {
+  computeLevels(decision);
+  m_tree.constructImageLevels(res, m_levels);
+}
+
+template <class T>
+void FilterSession<T>::constructImage(Image<T>& res,
+                                      ConstructionDecision decision) {
+  constructImage(ComponentTree<T>::outputBuffer(res, m_tree.m_img.getSize()),
+                 decision);
+}
+
+template <class T>
+Image<T> FilterSession<T>::constructImage(ConstructionDecision decision) {
+  Image<T> res(m_tree.m_img.getSize());
+  constructImage(res.getData(), decision);
+  return res;
+}
+
+}  // namespace LibTIM
@@ -0,0 +1,127 @@
+/*
+ * This file is part of libTIM.
+ *
+ * Copyright (©) 2005-2013  Benoit Naegel
+ * Copyright (©) 2013 Theo de Carpentier
+ * Copyright (©) 2022-2023  Cyril Meyer
+ */
+
+#ifndef Node_h
+#define Node_h
+
+#include <limits>
+#include <vector>
+
+#include "Common/Types.h"
+
+namespace LibTIM {
+
+const int localMax = std::numeric_limits<int>::max();
+const int localMin = std::numeric_limits<int>::min();
+
+/** @brief Node of a component tree: a connected component of a level set
+ * (see ComponentTree)
+ **/
+struct Node {
+  Node()
+      : label(-1),
+        xmin(localMax),
+        ymin(localMax),
+        xmax(localMin),
+        ymax(localMin),
+        zmin(localMax),
+        zmax(localMin),
+        area(0),
+        area_derivative_areaN_h(std::numeric_limits<long double>::max()),
+        area_derivative_areaN_h_derivative(
+            std::numeric_limits<long double>::max()),
+        area_derivative_h(std::numeric_limits<long double>::max()),
+        area_derivative_areaN(std::numeric_limits<long double>::max()),
+        mser(std::numeric_limits<long double>::max()),
+        area_derivative_delta_h(std::numeric_limits<long double>::max()),
+        area_derivative_delta_areaF(std::numeric_limits<long double>::max()),
+        sum(0),
+        sum_square(0),
+        mean(0),
+        variance(0),
+        area_nghb(0),
+        sum_nghb(0),
+        sum_square_nghb(0),
+        mean_nghb(0),
+        variance_nghb(0),
+        contrast(0),
+        volume(0),
+        contourLength(0),
+        complexity(0),
+        subNodes(0),
+        status(true),
+        active(true),
+        id(-1),
+        father(0) {
+    pixels.reserve(7);
+    childs.reserve(5);
+  }
+  int label;
+  int ori_h;
+  int h;
+  int xmin;
+  int ymin;
+  int xmax;
+  int ymax;
+  int zmin;
+  int zmax;
+  int64_t area;
+  // father correspond au noeud père
+  long double area_derivative_areaN_h;
+  long double area_derivative_areaN_h_derivative;
+  // (aire(father) - aire(noeud) / (h(noeud) - h(father))
+  long double area_derivative_h;
+  // (aire(father) - aire(noeud)) / aire(noeud)
+  long double area_derivative_areaN;
+  // father_d correspond au noeud dans la branche parent tel que  (h(noeud) -
+  // h(father_d)) >= delta (aire(father_d) - aire(noeud)) / aire(noeud)
+  long double mser;
+  // (aire(father_d) - aire(noeud)) / (h(noeud) - h(father_d))
+  long double area_derivative_delta_h;
+  // (aire(father_d) - aire(noeud)) / aire(father_d)
+  long double area_derivative_delta_areaF;
+  // otsu
+  int64_t sum;
+  int64_t sum_square;
+  long double mean;
+  long double variance;
+  int64_t area_nghb;
+  int64_t sum_nghb;
+  int64_t sum_square_nghb;
+  long double mean_nghb;
+  long double variance_nghb;
+  long double otsu;
+
+  int contrast;
+  int volume;
+  long double mean_gradient_border;
+  int contourLength;
+  int complexity;
+  int compacity;
+
+  int64_t subNodes;
+
+  bool status;
+  bool active;
+
+  // position in ComponentTree::m_nodes (breadth-first order)
+  int id;
+
+  // Common to all type of nodes:
+  Node *father;
+  typedef std::vector<TOffset> ContainerPixels;
+  ContainerPixels pixels;
+  ContainerPixels pixels_border;
+  typedef std::vector<Node *> ContainerChilds;
+  ContainerChilds childs;
+  ContainerPixels contour;
+};
+
+}  // namespace LibTIM
+
+#endif
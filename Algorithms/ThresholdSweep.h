@@ -0,0 +1,81 @@
+/*
+ * This file is part of libTIM.
+ *
+ * Copyright (©) 2005-2013  Benoit Naegel
+ * Copyright (©) 2013 Theo de Carpentier
+ * Copyright (©) 2022-2023  Cyril Meyer
+ */
+
+#ifndef ThresholdSweep_h
+#define ThresholdSweep_h
+
+#include "ComponentTree.h"
+
+namespace LibTIM {
+
+/** @brief Filtered images for an increasing sequence of thresholds
+ * The nodes kept at threshold t are the ones whose value (per-node column,
+ * indexed by Node::id) is >= t, with the MIN, MAX or DIRECT rule
+ * (SUBTRACTIVE, which is not a selection rule, gives the DIRECT images).
+ * The nodes are sorted once by the threshold at which they are removed;
+ * going to the next threshold only rewrites the pixels of the nodes removed
+ * in between, so a whole sweep costs O(pixels + nodes log nodes) plus the
+ * changed pixels, instead of a reconstruction per threshold.
+ * The tree is only read by the sweep; the constructor from an attribute
+ * computes the attribute on the tree if needed (see attributeColumn).
+ **/
+template <class T>
+class ThresholdSweep {
+ public:
+  typedef typename ComponentTree<T>::ConstructionDecision ConstructionDecision;
+  typedef typename ComponentTree<T>::Attribute Attribute;
+
+  ThresholdSweep(const ComponentTree<T> &tree,
+                 const std::vector<long double> &column,
+                 ConstructionDecision decision = ComponentTree<T>::MIN);
+  ThresholdSweep(ComponentTree<T> &tree, Attribute attribute_id,
+                 ConstructionDecision decision = ComponentTree<T>::MIN);
+
+  /**
+   * @brief Back to the unfiltered image (all the nodes kept)
+   **/
+  void reset();
+
+  /**
+   * @brief Filtered image at threshold t
+   * The image is updated in place and stays valid until the next call.
+   * Only the nodes removed since the previous threshold are rewritten; a
+   * threshold lower than the previous one restarts the sweep (reset()).
+   **/
+  const Image<T> &advance(long double t);
+
+  const Image<T> &image() const { return m_res; }
+
+ private:
+  void init(const std::vector<long double> &column);
+  // nearest ancestor (or self) not removed, -1 if none
+  int keptAncestor(int id);
+  void remove(int id);
+
+  const ComponentTree<T> &m_tree;
+  ConstructionDecision m_decision;
+  Image<T> m_res;
+
+  // threshold from which each node is removed, indexed by Node::id
+  std::vector<long double> m_key;
+  // nodes by removal order
+  std::vector<int> m_order;
+  int m_position;
+  // threshold of the current image
+  long double m_threshold;
+
+  // removed nodes point to their father, kept nodes to themselves
+  std::vector<int> m_kept;
+  // pixels at the level of each node: linked lists through m_next
+  std::vector<TOffset> m_head, m_tail, m_next;
+};
+
+}  // namespace LibTIM
+
+#include "ThresholdSweep.hxx"
+#endif
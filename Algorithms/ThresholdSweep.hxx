@@ -0,0 +1,133 @@
+/*
+ * This file is part of libTIM.
+ *
+ * Copyright (©) 2005-2013  Benoit Naegel
+ * Copyright (©) 2013 Theo de Carpentier
+ * Copyright (©) 2022-2023  Cyril Meyer
+ */
+
+#include <algorithm>
+#include <limits>
+
+namespace LibTIM {
+
+template <class T>
+ThresholdSweep<T>::ThresholdSweep(const ComponentTree<T>& tree,
+                                  const std::vector<long double>& column,
+                                  ConstructionDecision decision)
+    : m_tree(tree), m_decision(decision), m_res(tree.m_img.getSize()) {
+  init(column);
+}
+
+template <class T>
+ThresholdSweep<T>::ThresholdSweep(ComponentTree<T>& tree,
+                                  Attribute attribute_id,
+                                  ConstructionDecision decision)
+    : m_tree(tree), m_decision(decision), m_res(tree.m_img.getSize()) {
+  init(tree.attributeColumn(attribute_id));
+}
+
+// Removal threshold of each node:
+// MIN, a node goes with its first ancestor under the threshold (min on the
+// path to the root); MAX, a node stays while a descendant is kept (max on
+// the subtree); DIRECT, its own value.
+// Ties are removed from the leaves (decreasing ids), so the father of a
+// removed node is still kept for MIN and MAX.
+template <class T>
+void ThresholdSweep<T>::init(const std::vector<long double>& column) {
+  const std::vector<Node*>& nodes = m_tree.m_nodes;
+  m_key = column;
+  if (m_decision == ComponentTree<T>::MIN) {
+    for (int i = 1; i < nodes.size(); i++)
+      m_key[i] = std::min(m_key[i], m_key[nodes[i]->father->id]);
+  } else if (m_decision == ComponentTree<T>::MAX) {
+    for (int i = nodes.size() - 1; i > 0; i--) {
+      long double& f = m_key[nodes[i]->father->id];
+      f = std::max(f, m_key[i]);
+    }
+  }
+
+  m_order.resize(nodes.size());
+  for (int i = 0; i < nodes.size(); i++) m_order[i] = i;
+  const std::vector<long double>& key = m_key;
+  std::sort(m_order.begin(), m_order.end(), [&key](int a, int b) {
+    return key[a] < key[b] || (key[a] == key[b] && a > b);
+  });
+
+  m_next.resize(m_res.getBufSize());
+  reset();
+}
+
+template <class T>
+void ThresholdSweep<T>::reset() {
+  const std::vector<Node*>& nodes = m_tree.m_nodes;
+  m_position = 0;
+  m_threshold = -std::numeric_limits<long double>::infinity();
+  m_kept.resize(nodes.size());
+  m_head.assign(nodes.size(), -1);
+  m_tail.assign(nodes.size(), -1);
+
+  if (nodes.empty()) m_res.fill(T(0));
+  for (int i = 0; i < nodes.size(); i++) {
+    m_kept[i] = i;
+    const Node::ContainerPixels& pixels = nodes[i]->pixels;
+    T level = (T)nodes[i]->h;
+    TOffset previous = -1;
+    for (int p = 0; p < pixels.size(); p++) {
+      m_res(pixels[p]) = level;
+      if (previous == -1)
+        m_head[i] = pixels[p];
+      else
+        m_next[previous] = pixels[p];
+      previous = pixels[p];
+    }
+    if (previous != -1) m_next[previous] = -1;
+    m_tail[i] = previous;
+  }
+}
+
+template <class T>
+int ThresholdSweep<T>::keptAncestor(int id) {
+  int a = id;
+  while (a != -1 && m_kept[a] != a) a = m_kept[a];
+  // path compression
+  while (id != a) {
+    int next = m_kept[id];
+    m_kept[id] = a;
+    id = next;
+  }
+  return a;
+}
+
+// The pixels at the level of a removed node go to its nearest kept ancestor
+// (0 when there is none)
+template <class T>
+void ThresholdSweep<T>::remove(int id) {
+  Node* n = m_tree.m_nodes[id];
+  m_kept[id] = (n->father == n) ? -1 : n->father->id;
+  int a = keptAncestor(id);
+
+  T level = (a == -1) ? T(0) : (T)m_tree.m_nodes[a]->h;
+  for (TOffset p = m_head[id]; p != -1; p = m_next[p]) m_res(p) = level;
+
+  if (a != -1 && m_head[id] != -1) {
+    if (m_head[a] == -1)
+      m_head[a] = m_head[id];
+    else
+      m_next[m_tail[a]] = m_head[id];
+    m_tail[a] = m_tail[id];
+  }
+  m_head[id] = m_tail[id] = -1;
+}
+
+template <class T>
+const Image<T>& ThresholdSweep<T>::advance(long double t) {
+  // removed nodes are not restored: replay the sweep from the start
+  if (t < m_threshold) reset();
+  m_threshold = t;
+  while (m_position < m_order.size() && m_key[m_order[m_position]] < t)
+    remove(m_order[m_position++]);
+  return m_res;
+}
+
+}  // namespace LibTIM
@@ -10,6 +10,7 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <vector>
 
 namespace LibTIM {
 
@@ -256,4 +257,66 @@ inline int Image<RGB>::save(const char *filename) {
   return 1;
 }
 
+/// element type of a .npy file (little-endian)
+template <class T>
+struct NpyDescr;
+template <>
+struct NpyDescr<U8> {
+  static const char *get() { return "|u1"; }
+};
+template <>
+struct NpyDescr<U16> {
+  static const char *get() { return "<u2"; }
+};
+template <>
+struct NpyDescr<int> {
+  static const char *get() { return "<i4"; }
+};
+template <>
+struct NpyDescr<float> {
+  static const char *get() { return "<f4"; }
+};
+template <>
+struct NpyDescr<double> {
+  static const char *get() { return "<f8"; }
+};
+
+/// Npy writer (format 1.0, C order): data holds the product of shape values
+template <class T>
+inline int saveNpy(const char *filename, const T *data,
+                   const std::vector<TSize> &shape) {
+  std::ofstream file(filename, std::ios_base::trunc | std::ios_base::binary);
+  if (!file) {
+    std::cerr << "Image file I/O error\n";
+    return 0;
+  }
+
+  std::ostringstream header;
+  header << "{'descr': '" << NpyDescr<T>::get()
+         << "', 'fortran_order': False, 'shape': (";
+  TSize count = 1;
+  for (int i = 0; i < shape.size(); i++) {
+    header << (i > 0 ? ", " : "") << shape[i];
+    count *= shape[i];
+  }
+  header << (shape.size() == 1 ? ",), }" : "), }");
+
+  // magic string, version and header length take 10 bytes, the header ends
+  // with '\n' and is padded with spaces so that the data is 64-byte aligned
+  std::string str = header.str();
+  str.append(63 - (10 + str.size()) % 64, ' ');
+  str += '\n';
+  unsigned short length = str.size();
+
+  file.write("\x93NUMPY\x01\x00", 8);
+  file.put((char)(length & 0xff));
+  file.put((char)(length >> 8));
+  file << str;
+  file.write(reinterpret_cast<const char *>(data), count * sizeof(T));
+
+  file.close();
+
+  return 1;
+}
+
 }  // namespace LibTIM
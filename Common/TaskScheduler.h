@@ -0,0 +1,97 @@
+/*
+ * This file is part of libTIM.
+ *
+ * Copyright (©) 2005-2013  Benoit Naegel
+ * Copyright (©) 2013 Theo de Carpentier
+ * Copyright (©) 2022-2023  Cyril Meyer
+ */
+
+#ifndef TaskScheduler_h
+#define TaskScheduler_h
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace LibTIM {
+
+/** @brief Work-stealing task scheduler
+ * Each thread owns a queue: it pushes and pops its own tasks at the back
+ * (depth first) and steals from the front of the other queues when it has
+ * nothing left (breadth first, i.e. the largest pending tasks).
+ * Threads which are not workers of the scheduler (e.g. the main thread)
+ * share an extra queue, so they can spawn and wait like the workers.
+ * A thread waiting for a group executes pending tasks instead of blocking,
+ * so tasks may spawn and wait for sub-tasks recursively.
+ **/
+class TaskScheduler {
+ public:
+  typedef std::function<void()> Task;
+
+  /** @brief Set of tasks that can be waited for
+   **/
+  class TaskGroup {
+   public:
+    TaskGroup() : pending(0) {}
+
+   private:
+    friend class TaskScheduler;
+    TaskGroup(const TaskGroup &);
+    std::atomic<int> pending;
+  };
+
+  // nbThreads <= 0 uses the number of cores
+  explicit TaskScheduler(int nbThreads = 0);
+  ~TaskScheduler();
+
+  /// number of threads running tasks (including the waiting caller)
+  int getNumberOfThreads() const { return m_nbThreads; }
+
+  void spawn(TaskGroup &group, const Task &task);
+  void wait(TaskGroup &group);
+
+  /// f(i) for i in [begin, end), by chunks of grain indices
+  template <class F>
+  void parallelFor(std::size_t begin, std::size_t end, std::size_t grain,
+                   const F &f);
+
+ private:
+  TaskScheduler(const TaskScheduler &);
+  TaskScheduler &operator=(const TaskScheduler &);
+
+  struct Job {
+    Task task;
+    TaskGroup *group;
+  };
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+  };
+
+  int currentQueue() const;
+  bool pop(int queue, Job &job);
+  void run(Job &job);
+  void workerLoop(int queue);
+
+  int m_nbThreads;
+  // m_queues[0] is shared by the threads which are not workers
+  std::vector<WorkQueue *> m_queues;
+  std::vector<std::thread> m_workers;
+  // number of jobs in the queues, changed under m_sleepMutex when increased
+  std::atomic<int> m_queued;
+  std::atomic<bool> m_stop;
+  std::mutex m_sleepMutex;
+  std::condition_variable m_wakeUp;
+};
+
+}  // namespace LibTIM
+
+#include "TaskScheduler.hxx"
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ * This file is part of libTIM.
+ *
+ * Copyright (©) 2005-2013  Benoit Naegel
+ * Copyright (©) 2013 Theo de Carpentier
+ * Copyright (©) 2022-2023  Cyril Meyer
+ */
+
+namespace LibTIM {
+
+namespace TaskSchedulerDetail {
+// scheduler and queue of the calling thread, if it is a worker
+struct WorkerIdentity {
+  const TaskScheduler *scheduler;
+  int queue;
+};
+
+inline WorkerIdentity &currentWorker() {
+  static thread_local WorkerIdentity identity = {0, 0};
+  return identity;
+}
+}  // namespace TaskSchedulerDetail
+
+inline TaskScheduler::TaskScheduler(int nbThreads)
+    : m_queued(0), m_stop(false) {
+  if (nbThreads <= 0) nbThreads = std::thread::hardware_concurrency();
+  if (nbThreads <= 0) nbThreads = 1;
+  m_nbThreads = nbThreads;
+
+  for (int i = 0; i < m_nbThreads; i++) m_queues.push_back(new WorkQueue);
+  // the waiting caller is the last thread
+  for (int i = 1; i < m_nbThreads; i++)
+    m_workers.push_back(std::thread(&TaskScheduler::workerLoop, this, i));
+}
+
+inline TaskScheduler::~TaskScheduler() {
+  {
+    std::lock_guard<std::mutex> lock(m_sleepMutex);
+    m_stop = true;
+  }
+  m_wakeUp.notify_all();
+  for (int i = 0; i < m_workers.size(); i++) m_workers[i].join();
+  for (int i = 0; i < m_queues.size(); i++) delete m_queues[i];
+}
+
+inline int TaskScheduler::currentQueue() const {
+  TaskSchedulerDetail::WorkerIdentity &identity =
+      TaskSchedulerDetail::currentWorker();
+  return identity.scheduler == this ? identity.queue : 0;
+}
+
+inline void TaskScheduler::spawn(TaskGroup &group, const Task &task) {
+  Job job = {task, &group};
+  group.pending++;
+
+  WorkQueue *queue = m_queues[currentQueue()];
+  {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    queue->jobs.push_back(job);
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_sleepMutex);
+    m_queued++;
+  }
+  m_wakeUp.notify_one();
+}
+
+inline bool TaskScheduler::pop(int queue, Job &job) {
+  // own queue first, newest job
+  {
+    WorkQueue *own = m_queues[queue];
+    std::lock_guard<std::mutex> lock(own->mutex);
+    if (!own->jobs.empty()) {
+      job = own->jobs.back();
+      own->jobs.pop_back();
+      m_queued--;
+      return true;
+    }
+  }
+  // then steal the oldest job of another queue
+  for (int i = 1; i < m_queues.size(); i++) {
+    WorkQueue *victim = m_queues[(queue + i) % m_queues.size()];
+    std::lock_guard<std::mutex> lock(victim->mutex);
+    if (!victim->jobs.empty()) {
+      job = victim->jobs.front();
+      victim->jobs.pop_front();
+      m_queued--;
+      return true;
+    }
+  }
+  return false;
+}
+
+inline void TaskScheduler::run(Job &job) {
+  job.task();
+  job.group->pending--;
+}
+
+inline void TaskScheduler::wait(TaskGroup &group) {
+  int queue = currentQueue();
+  Job job;
+  while (group.pending > 0) {
+    if (pop(queue, job))
+      run(job);
+    else
+      std::this_thread::yield();
+  }
+}
+
+inline void TaskScheduler::workerLoop(int queue) {
+  TaskSchedulerDetail::WorkerIdentity &identity =
+      TaskSchedulerDetail::currentWorker();
+  identity.scheduler = this;
+  identity.queue = queue;
+
+  Job job;
+  while (true) {
+    if (pop(queue, job)) {
+      run(job);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(m_sleepMutex);
+    m_wakeUp.wait(lock, [this] { return m_stop || m_queued > 0; });
+    if (m_stop) break;
+  }
+}
+
+template <class F>
+void TaskScheduler::parallelFor(std::size_t begin, std::size_t end,
+                                std::size_t grain, const F &f) {
+  if (grain == 0) grain = 1;
+  if (m_nbThreads == 1 || end - begin <= grain) {
+    for (std::size_t i = begin; i < end; i++) f(i);
+    return;
+  }
+
+  TaskGroup group;
+  for (std::size_t first = begin; first < end; first += grain) {
+    std::size_t last = std::min(end, first + grain);
+    spawn(group, [&f, first, last] {
+      for (std::size_t i = first; i < last; i++) f(i);
+    });
+  }
+  wait(group);
+}
+
+}  // namespace LibTIM
@@ -3,14 +3,24 @@ CONFIG += console c++11
 CONFIG -= app_bundle
 CONFIG -= qt
 
+LIBS += -pthread
+
 SOURCES += \
         preprocess_nenist.cpp
 
 HEADERS += \
+    Algorithms/Accumulators.h \
+    Algorithms/AttributeKernels.h \
+    Algorithms/AttributeKernels.hxx \
     Algorithms/ComponentTree.h \
     Algorithms/ComponentTree.hxx \
+    Algorithms/FilterSession.h \
+    Algorithms/FilterSession.hxx \
+    Algorithms/ThresholdSweep.h \
+    Algorithms/ThresholdSweep.hxx \
     Algorithms/Morphology.h \
     Algorithms/Morphology.hxx \
+    Algorithms/Node.h \
     Common/FlatSE.h \
     Common/FlatSE.hxx \
     Common/Image.h \
@@ -18,4 +28,6 @@ HEADERS += \
     Common/ImageIO.hxx \
     Common/ImageIterators.h \
     Common/Point.h \
+    Common/TaskScheduler.h \
+    Common/TaskScheduler.hxx \
     Common/Types.h
@@ -0,0 +1,221 @@
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+#include "Common/Image.h"
+#include "Common/FlatSE.h"
+#include "Algorithms/ComponentTree.h"
+
+using namespace LibTIM;
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Attribute computation time for 1, 2, 4, ... threads (up to maxThreads),
+// the tree being built once per run without attributes.
+void benchmarkAttributes(Image<U8> &im, int repetitions, int maxThreads)
+{
+    FlatSE connexity;
+    connexity.make2DN8();
+
+    // OTSU is left out: its neighborhood computation is sequential
+    int ca = ComputedAttributes::AREA | ComputedAttributes::AREA_DERIVATIVES |
+             ComputedAttributes::CONTRAST |
+             ComputedAttributes::VOLUME | ComputedAttributes::BOUNDING_BOX |
+             ComputedAttributes::SUB_NODES;
+
+    double reference = 0;
+
+    std::cout << "[INFO] attributes" << std::endl;
+    for (int threads = 1; ; threads *= 2)
+    {
+        threads = std::min(threads, maxThreads);
+        double best = std::numeric_limits<double>::max();
+        size_t nodes = 0;
+        for (int r = 0; r < repetitions; ++r)
+        {
+            ComponentTree<U8> tree(im, connexity, (ComputedAttributes)0, 5);
+            tree.setNumberOfThreads(threads);
+            nodes = tree.m_nodes.size();
+
+            Clock::time_point start = Clock::now();
+            tree.computeAttributes(ca);
+            best = std::min(best, elapsedMs(start));
+        }
+        if (threads == 1)
+            reference = best;
+
+        std::cout << threads << " thread(s): " << best << " ms, "
+                  << nodes / best * 1000.0 << " nodes/s, speedup "
+                  << reference / best << std::endl;
+        if (threads == maxThreads)
+            break;
+    }
+}
+
+// Throughput of the derived attribute kernels for each instruction set,
+// on the node arrays of the image tree.
+void benchmarkKernels(Image<U8> &im, int repetitions)
+{
+    FlatSE connexity;
+    connexity.make2DN8();
+    ComponentTree<U8> tree(im, connexity, ComputedAttributes::AREA, 5);
+
+    size_t n = tree.m_nodes.size();
+    std::vector<double> area(n), sum(n), sumSquare(n), h(n), fatherArea(n), fatherH(n);
+    std::vector<double> contourLength(n), zero(n, 0.0);
+    for (size_t i = 0; i < n; ++i)
+    {
+        Node *node = tree.m_nodes[i];
+        area[i] = node->area;
+        sum[i] = node->sum;
+        sumSquare[i] = node->sum_square;
+        h[i] = node->h;
+        fatherArea[i] = node->father->area;
+        fatherH[i] = node->father->h;
+        contourLength[i] = 4 * std::sqrt((double)node->area);
+    }
+    std::vector<double> out1(n), out2(n), out3(n);
+    std::vector<int> complexity(n), compacity(n);
+
+    const char *names[] = {"scalar", "SSE2", "AVX2"};
+    std::cout << "[INFO] derived attribute kernels" << std::endl;
+    for (int level = SIMD_SCALAR; level <= bestSimdLevel(); ++level)
+    {
+        double best = std::numeric_limits<double>::max();
+        for (int r = 0; r < repetitions; ++r)
+        {
+            Clock::time_point start = Clock::now();
+            AttributeKernels::statistics(n, &area[0], &sum[0], &sumSquare[0], &zero[0], &zero[0],
+                                         &out1[0], &out2[0], &out3[0], (SimdLevel)level);
+            AttributeKernels::areaDerivatives(n, &area[0], &fatherArea[0], &h[0], &fatherH[0],
+                                              &out1[0], &out2[0], &out3[0], (SimdLevel)level);
+            AttributeKernels::difference(n, &out1[0], &out2[0], &out3[0], (SimdLevel)level);
+            AttributeKernels::complexityAndCompacity(n, &contourLength[0], &area[0],
+                                                     &complexity[0], &compacity[0],
+                                                     (SimdLevel)level);
+            best = std::min(best, elapsedMs(start));
+        }
+        std::cout << names[level] << ": " << best << " ms, "
+                  << n / best * 1000.0 << " nodes/s" << std::endl;
+    }
+}
+
+// Rendering time of a filtered image and of an attribute image for 1, 2, 4,
+// ... threads (up to maxThreads), the tree being built once.
+void benchmarkRendering(Image<U8> &im, FlatSE &connexity, int repetitions, int maxThreads)
+{
+    ComponentTree<U8> tree(im, connexity, ComputedAttributes::AREA, 5);
+    tree.areaFiltering(100);
+    Image<U8> res(im.getSize());
+    Image<int> attributes(im.getSize());
+
+    double reference[2] = {0, 0};
+
+    std::cout << "[INFO] rendering " << im.getSizeX() << "x" << im.getSizeY() << "x"
+              << im.getSizeZ() << std::endl;
+    for (int threads = 1; ; threads *= 2)
+    {
+        threads = std::min(threads, maxThreads);
+        tree.setNumberOfThreads(threads);
+        double best[2] = {std::numeric_limits<double>::max(), std::numeric_limits<double>::max()};
+        for (int r = 0; r < repetitions; ++r)
+        {
+            Clock::time_point start = Clock::now();
+            tree.constructImage(res, ComponentTree<U8>::MIN);
+            best[0] = std::min(best[0], elapsedMs(start));
+
+            start = Clock::now();
+            tree.constructImageAttribute<int, long double>(attributes, ComponentTree<U8>::AREA,
+                                                           ComponentTree<U8>::AREA,
+                                                           ComponentTree<U8>::DIRECT);
+            best[1] = std::min(best[1], elapsedMs(start));
+        }
+        if (threads == 1)
+        {
+            reference[0] = best[0];
+            reference[1] = best[1];
+        }
+
+        std::cout << threads << " thread(s): image " << best[0] << " ms (speedup "
+                  << reference[0] / best[0] << "), attribute image " << best[1]
+                  << " ms (speedup " << reference[1] / best[1] << ")" << std::endl;
+        if (threads == maxThreads)
+            break;
+    }
+}
+
+// Synthetic volume: smooth blobs and noise
+Image<U8> syntheticVolume(int side)
+{
+    Image<U8> vol(side, side, side);
+    srand(1);
+    const int blobs = 16;
+    double cx[blobs], cy[blobs], cz[blobs], r[blobs], a[blobs];
+    for (int i = 0; i < blobs; ++i)
+    {
+        cx[i] = rand() % side;
+        cy[i] = rand() % side;
+        cz[i] = rand() % side;
+        r[i] = 2 + rand() % std::max(1, side / 4);
+        a[i] = 40 + rand() % 120;
+    }
+    for (int z = 0; z < side; ++z)
+        for (int y = 0; y < side; ++y)
+            for (int x = 0; x < side; ++x)
+            {
+                double v = 20 + rand() % 24;
+                for (int i = 0; i < blobs; ++i)
+                {
+                    double d = ((x - cx[i]) * (x - cx[i]) + (y - cy[i]) * (y - cy[i]) +
+                                (z - cz[i]) * (z - cz[i])) / (r[i] * r[i]);
+                    v += a[i] * std::exp(-d);
+                }
+                vol(x, y, z) = (U8)std::min(255.0, v);
+            }
+    return vol;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc <= 1)
+    {
+        std::cout << "usage: " << argv[0] << " <imgSrc> [repetitions] [maxThreads] [volumeSide]" << std::endl;
+        exit(-1);
+    }
+    int repetitions = argc > 2 ? atoi(argv[2]) : 5;
+    int cores = std::max(1, (int)std::thread::hardware_concurrency());
+    int maxThreads = argc > 3 ? atoi(argv[3]) : cores;
+    std::cout << "[INFO] " << cores << " core(s)" << std::endl;
+
+    Image<U8> im;
+    if (Image<U8>::load(argv[1], im))
+        std::cout << "[INFO] " << argv[1] << " image is loaded" << std::endl;
+    else
+    {
+        std::cout << "[ERRO] " << argv[1] << " impossible to load the input image" << std::endl;
+        exit(-1);
+    }
+
+    benchmarkAttributes(im, repetitions, maxThreads);
+    benchmarkKernels(im, repetitions);
+
+    FlatSE connexity;
+    connexity.make2DN8();
+    benchmarkRendering(im, connexity, repetitions, maxThreads);
+
+    if (argc > 4)
+    {
+        Image<U8> vol = syntheticVolume(atoi(argv[4]));
+        FlatSE connexity3D;
+        connexity3D.make3DN6();
+        benchmarkRendering(vol, connexity3D, repetitions, maxThreads);
+    }
+
+    return 0;
+}
@@ -4,6 +4,7 @@
 #include "Common/Image.h"
 #include "Common/FlatSE.h"
 #include "Algorithms/ComponentTree.h"
+#include "Algorithms/FilterSession.h"
 
 using namespace LibTIM;
 
@@ -35,30 +36,6 @@ std::string getfname(char* argv1, const char* fname)
     return getfname(argv1, std::string(fname));
 }
 
-template<class T>
-Image<U8> normalize(Image<T> image, T limit_in = 0)
-{
-    Image<U8> res(image.getSize());
-    T limit = std::max(image.getMax(), (T)1);
-
-    if(limit_in != 0)
-    {
-        limit = limit_in;
-    }
-
-    for (TSize x = 0; x < image.getSizeX(); x++) {
-        for (TSize y = 0; y < image.getSizeY(); y++) {
-            for (TSize z = 0; z < image.getSizeZ(); z++) {
-                long double normalized_val =
-                        ((long double)std::min(image(x, y, z), limit) / (long double)limit);
-                int c = ((long double)normalized_val*255.0);
-                res(x, y, z) = c;
-            }
-        }
-    }
-    return res;
-}
-
 int main(int argc, char *argv[])
 {
     bool debug = true;
@@ -88,8 +65,6 @@ int main(int argc, char *argv[])
     }
     // Image résultat
     Image<U8> res;
-    Image<int> res_int;
-    Image<long double> res_longdouble;
     // Arbre des composantes
     ComponentTree<U8> *tree;
     FlatSE connexity;
@@ -108,189 +83,105 @@ int main(int argc, char *argv[])
 
     int64_t limit_criterion_min = 0;
     int64_t limit_criterion_max = 1048576;
-    ComponentTree<U8>::Attribute attribute;
     ComponentTree<U8>::Attribute criterion;
     ComponentTree<U8>::Attribute limit_criterion = ComponentTree<U8>::AREA;
 
-    // CONTRAST, MAX AREA_D_AREAN_H_D, LIMIT AREA 1048576
-    attribute = ComponentTree<U8>::CONTRAST;
+    // CONTRAST, VOLUME and COMPLEXITY (MAX AREA_D_AREAN_H_D, LIMIT AREA 1048576)
+    // and COMPACITY (MAX AREA_D_AREAN_H_D), computed together
+    typedef ComponentTree<U8>::AttributeImageSpec AttributeImageSpec;
     criterion = ComponentTree<U8>::AREA_D_AREAN_H_D;
-    res_int =
-            tree->constructImageAttribute<int, long double, int64_t>
-            (attribute, criterion, ComponentTree<U8>::MAX,
-             limit_criterion, limit_criterion_min, limit_criterion_max);
-    res = normalize<int>(res_int);
-    if(debug)
+    std::vector<AttributeImageSpec> specs;
+    specs.push_back(AttributeImageSpec(ComponentTree<U8>::CONTRAST, criterion, ComponentTree<U8>::MAX,
+                                       limit_criterion, limit_criterion_min, limit_criterion_max));
+    specs.push_back(AttributeImageSpec(ComponentTree<U8>::VOLUME, criterion, ComponentTree<U8>::MAX,
+                                       limit_criterion, limit_criterion_min, limit_criterion_max));
+    specs.push_back(AttributeImageSpec(ComponentTree<U8>::COMPLEXITY, criterion, ComponentTree<U8>::MAX,
+                                       limit_criterion, limit_criterion_min, limit_criterion_max));
+    specs.push_back(AttributeImageSpec(ComponentTree<U8>::COMPACITY, criterion, ComponentTree<U8>::MAX));
+    // scaled to U8 up to their maximum (COMPACITY up to 50)
+    std::vector<ValueRange> ranges(3);
+    ranges.push_back(ValueRange(0, 50));
+    std::vector<Image<U8>> res_u8 =
+            tree->constructImageAttributes<U8, long double, int64_t>(specs, ranges);
+
+    const char *names[] = {"CONTRAST, MAX AREA_D_AREAN_H_D, LIMIT AREA 1048576",
+                           "VOLUME, MAX AREA_D_AREAN_H_D, LIMIT AREA 1048576",
+                           "COMPLEXITY, MAX AREA_D_AREAN_H_D, LIMIT AREA 1048576"};
+    const char *suffixes[] = {"CONTRAST-MAX_AREA_D_AREAN_H_D-LIMIT_AREA",
+                              "VOLUME-MAX_AREA_D_AREAN_H_D-LIMIT_AREA",
+                              "COMPLEXITY-MAX_AREA_D_AREAN_H_D-LIMIT_AREA"};
+    for (int i = 0; i < 3; ++i)
     {
-        std::cout << "CONTRAST, MAX AREA_D_AREAN_H_D, LIMIT AREA 1048576" << std::endl;
-        std::cout << (int)res_int.getMin() << " " << (int)res_int.getMax() << std::endl;
-        std::cout << (int)res.getMin() << " " << (int)res.getMax() << std::endl;
-    }
-    res.save(getfname(argv[1], "CONTRAST-MAX_AREA_D_AREAN_H_D-LIMIT_AREA").c_str());
-
-    // VOLUME, MAX AREA_D_AREAN_H_D, LIMIT AREA 1048576
-    attribute = ComponentTree<U8>::VOLUME;
-    criterion = ComponentTree<U8>::AREA_D_AREAN_H_D;
-    res_int =
-            tree->constructImageAttribute<int, long double, int64_t>
-            (attribute, criterion, ComponentTree<U8>::MAX,
-             limit_criterion, limit_criterion_min, limit_criterion_max);
-    res = normalize<int>(res_int);
-    if(debug)
-    {
-        std::cout << "VOLUME, MAX AREA_D_AREAN_H_D, LIMIT AREA 1048576" << std::endl;
-        std::cout << (int)res_int.getMin() << " " << (int)res_int.getMax() << std::endl;
-        std::cout << (int)res.getMin() << " " << (int)res.getMax() << std::endl;
-    }
-    res.save(getfname(argv[1], "VOLUME-MAX_AREA_D_AREAN_H_D-LIMIT_AREA").c_str());
-
-    // COMPLEXITY, MAX AREA_D_AREAN_H_D, LIMIT AREA 1048576
-    attribute = ComponentTree<U8>::COMPLEXITY;
-    criterion = ComponentTree<U8>::AREA_D_AREAN_H_D;
-    res_int =
-            tree->constructImageAttribute<int, long double, int64_t>
-            (attribute, criterion, ComponentTree<U8>::MAX,
-             limit_criterion, limit_criterion_min, limit_criterion_max);
-    res = normalize<int>(res_int);
-    if(debug)
-    {
-        std::cout << "COMPLEXITY, MAX AREA_D_AREAN_H_D, LIMIT AREA 1048576" << std::endl;
-        std::cout << (int)res_int.getMin() << " " << (int)res_int.getMax() << std::endl;
-        std::cout << (int)res.getMin() << " " << (int)res.getMax() << std::endl;
+        if(debug)
+        {
+            std::cout << names[i] << std::endl;
+            std::cout << (int)res_u8[i].getMin() << " " << (int)res_u8[i].getMax() << std::endl;
+        }
+        res_u8[i].save(getfname(argv[1], suffixes[i]).c_str());
     }
-    res.save(getfname(argv[1], "COMPLEXITY-MAX_AREA_D_AREAN_H_D-LIMIT_AREA").c_str());
 
     // MGB, MAX MGB, LIMIT AREA 1048576
-    attribute = ComponentTree<U8>::MGB;
-    criterion = ComponentTree<U8>::MGB;
-    res_longdouble =
-            tree->constructImageAttribute<long double, long double, int64_t>
-            (attribute, criterion, ComponentTree<U8>::MAX,
-             limit_criterion, limit_criterion_min, limit_criterion_max);
-    res = normalize<long double>(res_longdouble);
+    specs.clear();
+    specs.push_back(AttributeImageSpec(ComponentTree<U8>::MGB, ComponentTree<U8>::MGB, ComponentTree<U8>::MAX,
+                                       limit_criterion, limit_criterion_min, limit_criterion_max));
+    res = tree->constructImageAttributes<U8, long double, int64_t>(specs, std::vector<ValueRange>(1))[0];
     if(debug)
     {
         std::cout << "MGB, MAX MGB, LIMIT AREA 1048576" << std::endl;
-        std::cout << (int)res_int.getMin() << " " << (int)res_int.getMax() << std::endl;
         std::cout << (int)res.getMin() << " " << (int)res.getMax() << std::endl;
         res.save(getfname(argv[1], "MGB-MAX_MGB-LIMIT_AREA").c_str());
     }
 
     // COMPACITY (MAX = 50), MAX AREA_D_AREAN_H_D
-    attribute = ComponentTree<U8>::COMPACITY;
-    criterion = ComponentTree<U8>::AREA_D_AREAN_H_D;
-    res_int =
-            tree->constructImageAttribute<int, long double, int64_t>
-            (attribute, criterion, ComponentTree<U8>::MAX);
-    res = normalize<int>(res_int, 50);
     if(debug)
     {
         std::cout << "COMPACITY (MAX = 50), MAX AREA_D_AREAN_H_D" << std::endl;
-        std::cout << (int)res_int.getMin() << " " << (int)res_int.getMax() << std::endl;
-        std::cout << (int)res.getMin() << " " << (int)res.getMax() << std::endl;
+        std::cout << (int)res_u8[3].getMin() << " " << (int)res_u8[3].getMax() << std::endl;
     }
-    res.save(getfname(argv[1], "COMPACITY_MAX_50-MAX_AREA_D_AREAN_H_D").c_str());
+    res_u8[3].save(getfname(argv[1], "COMPACITY_MAX_50-MAX_AREA_D_AREAN_H_D").c_str());
 
-    // attributes signature images
-    std::vector<Node *> nodes = tree->indexedNodes();
-
-    std::vector<Image<long double>> res_sign;
-    std::vector<bool> set_sign;
+    // attributes signature images, the values being read as U8 before being scaled
+    std::vector<int> levels;
     for(int i = 0; i < 26 ; ++i)
     {
-        res_sign.push_back(im.getSize());
-        set_sign.push_back(true);
-        res_sign[i].fill(0);
+        levels.push_back(i*10);
     }
 
     // MGB (MAX = 150)
-    for (TSize x = 0; x < im.getSizeX(); x++) {
-        for (TSize y = 0; y < im.getSizeY(); y++) {
-            for (TSize z = 0; z < im.getSizeZ(); z++) {
-                for(int i = 0; i < 26 ; ++i)
-                {
-                    set_sign[i] = true;
-                }
-
-                Node* node = tree->indexedCoordToNode(x, y, z, nodes);
-
-                while(node != tree->m_root)
-                {
-                    for(int i = 0; i < 26 ; ++i)
-                    {
-                        if(set_sign[i] && node->h <= i*10)
-                        {
-                            res_sign[i](x, y, z) = node->mean_gradient_border;
-                            set_sign[i] = false;
-                        }
-                    }
-                    node = node->father;
-                }
-            }
-        }
-    }
+    tree->constructSignature<U8, U8>(res_u8, ComponentTree<U8>::MGB, levels, ValueRange(0, 150));
     for(int i = 0; i < 26 ; ++i)
     {
         if(debug)
         {
             std::cout << "SIGN_MGB_" << i*10 << std::endl;
-            std::cout << (int)res_sign[i].getMin() << " " << (int)res_sign[i].getMax() << std::endl;
+            std::cout << (int)res_u8[i].getMin() << " " << (int)res_u8[i].getMax() << std::endl;
         }
-        res = normalize<U8>(res_sign[i], 150);
-        res.save(getfname(argv[1], std::string("SIGN_MGB_") + std::to_string(i*10)).c_str());
+        res_u8[i].save(getfname(argv[1], std::string("SIGN_MGB_") + std::to_string(i*10)).c_str());
     }
 
     // OTSU (MAX = 20)
-    for(int i = 0; i < 26 ; ++i)
-    {
-        res_sign[i].fill(0);
-    }
-
-    for (TSize x = 0; x < im.getSizeX(); x++) {
-        for (TSize y = 0; y < im.getSizeY(); y++) {
-            for (TSize z = 0; z < im.getSizeZ(); z++) {
-                for(int i = 0; i < 26 ; ++i)
-                {
-                    set_sign[i] = true;
-                }
-
-                Node* node = tree->indexedCoordToNode(x, y, z, nodes);
-
-                while(node != tree->m_root)
-                {
-                    for(int i = 0; i < 26 ; ++i)
-                    {
-                        if(set_sign[i] && node->h <= i*10)
-                        {
-                            res_sign[i](x, y, z) = node->otsu;
-                            set_sign[i] = false;
-                        }
-                    }
-                    node = node->father;
-                }
-            }
-        }
-    }
+    tree->constructSignature<U8, U8>(res_u8, ComponentTree<U8>::OTSU, levels, ValueRange(0, 20));
     for(int i = 0; i < 26 ; ++i)
     {
         if(debug)
         {
             std::cout << "SIGN_OTSU_" << i*10 << std::endl;
-            std::cout << (int)res_sign[i].getMin() << " " << (int)res_sign[i].getMax() << std::endl;
+            std::cout << (int)res_u8[i].getMin() << " " << (int)res_u8[i].getMax() << std::endl;
         }
-        res = normalize<U8>(res_sign[i], 20);
-        res.save(getfname(argv[1], std::string("SIGN_OTSU_") + std::to_string(i*10)).c_str());
+        res_u8[i].save(getfname(argv[1], std::string("SIGN_OTSU_") + std::to_string(i*10)).c_str());
     }
 
+    // filters are applied to the same trees by independent sessions
+    ComponentTree<U8> *tree_dual = new ComponentTree<U8>(im_dual, connexity, 1);
+
     // area filtering
     int64_t area_min, area_max;
 
-    delete tree;
-    tree = new ComponentTree<U8>(im, connexity, 1);
     area_min = 2048;
     area_max = 1048576;
-    tree->areaFiltering(area_min, area_max);
-    res = tree->constructImage(ComponentTree<U8>::DIRECT);
+    FilterSession<U8> area_filter(*tree);
+    area_filter.areaFiltering(area_min, area_max);
+    res = area_filter.constructImage(ComponentTree<U8>::DIRECT);
     if(debug)
     {
         std::cout << "AREA 2048 1048576" << std::endl;
@@ -298,12 +189,11 @@ int main(int argc, char *argv[])
     }
     res.save(getfname(argv[1], "AREA_2048_1048576").c_str());
 
-    delete tree;
-    tree = new ComponentTree<U8>(im, connexity, 1);
     area_min = 4096;
     area_max = std::numeric_limits<int64_t>::max();
-    tree->areaFiltering(area_min, area_max);
-    res = tree->constructImage(ComponentTree<U8>::DIRECT);
+    area_filter.restore();
+    area_filter.areaFiltering(area_min, area_max);
+    res = area_filter.constructImage(ComponentTree<U8>::DIRECT);
     if(debug)
     {
         std::cout << "AREA 4096" << std::endl;
@@ -312,12 +202,11 @@ int main(int argc, char *argv[])
     res.save(getfname(argv[1], "AREA_4096").c_str());
 
     // area filtering dual
-    delete tree;
-    tree = new ComponentTree<U8>(im_dual, connexity, 1);
     area_min = 256;
     area_max = 262144;
-    tree->areaFiltering(area_min, area_max);
-    res = tree->constructImage(ComponentTree<U8>::DIRECT);
+    FilterSession<U8> area_dual_filter(*tree_dual);
+    area_dual_filter.areaFiltering(area_min, area_max);
+    res = area_dual_filter.constructImage(ComponentTree<U8>::DIRECT);
     if(debug)
     {
         std::cout << "AREA DUAL 256 262144" << std::endl;
@@ -328,12 +217,11 @@ int main(int argc, char *argv[])
     // contrast filtering
     int contrast_min, contrast_max;
 
-    delete tree;
-    tree = new ComponentTree<U8>(im, connexity, 1);
     contrast_min = 10;
     contrast_max = 100;
-    tree->contrastFiltering(contrast_min, contrast_max);
-    res = tree->constructImage(ComponentTree<U8>::DIRECT);
+    FilterSession<U8> contrast_filter(*tree);
+    contrast_filter.contrastFiltering(contrast_min, contrast_max);
+    res = contrast_filter.constructImage(ComponentTree<U8>::DIRECT);
     if(debug)
     {
         std::cout << "CONTRAST 10 100" << std::endl;
@@ -342,12 +230,11 @@ int main(int argc, char *argv[])
     res.save(getfname(argv[1], "CONTRAST_10_150").c_str());
 
     // contrast filtering dual
-    delete tree;
-    tree = new ComponentTree<U8>(im_dual, connexity, 1);
     contrast_min = 10;
     contrast_max = 100;
-    tree->contrastFiltering(contrast_min, contrast_max);
-    res = tree->constructImage(ComponentTree<U8>::DIRECT);
+    FilterSession<U8> contrast_dual_filter(*tree_dual);
+    contrast_dual_filter.contrastFiltering(contrast_min, contrast_max);
+    res = contrast_dual_filter.constructImage(ComponentTree<U8>::DIRECT);
     if(debug)
     {
         std::cout << "CONTRAST DUAL 10 100" << std::endl;
@@ -355,6 +242,9 @@ int main(int argc, char *argv[])
     }
     res.save(getfname(argv[1], "CONTRAST_DUAL_10_150").c_str());
 
+    delete tree;
+    delete tree_dual;
+
     std::cout << "[INFO] " << argv[1] << " end without error" << std::endl;
 
     return 0;